@@ -0,0 +1,173 @@
+#include "AsyncMatrixOperations.h"
+#include "Matrix.h"
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+
+// One operation in the dependency graph. Dependents are only ever linked to a node before it
+// finishes, and each holds a count of the inputs it is still waiting for.
+struct MatrixFuture::Node {
+    ThreadPool* pool;
+    std::function<double()> work;
+    std::promise<double> promise;
+    std::shared_future<double> result;
+
+    // Inputs not yet finished, plus one held by the scheduler until all inputs are linked
+    std::atomic<int> pending{1};
+
+    std::mutex mutex;
+    bool finished = false;
+    std::exception_ptr error;
+    std::vector<std::shared_ptr<Node>> inputs;
+    std::vector<std::shared_ptr<Node>> dependents;
+};
+
+/*
+MATRIXFUTURE FUNCTIONS
+*/
+bool MatrixFuture::valid() const {
+    return node != nullptr;
+}
+
+bool MatrixFuture::ready() const {
+    return node && node->result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+void MatrixFuture::wait() const {
+    if (!node) {
+        throw std::future_error(std::future_errc::no_state);
+    }
+
+    // Help with queued operations (a one-thread pool has no workers to run them). Once none is
+    // queued, the operation or an input it waits for is running on another thread, which queues
+    // whatever it unblocks for the workers: sleep until the result is set
+    while (!ready()) {
+        if (!node->pool->runPendingTask()) {
+            node->result.wait();
+        }
+    }
+}
+
+double MatrixFuture::get() const {
+    wait();
+    return node->result.get();
+}
+
+std::shared_future<double> MatrixFuture::share() const {
+    if (!node) {
+        throw std::future_error(std::future_errc::no_state);
+    }
+    return node->result;
+}
+
+/*
+ASYNCMATRIXOPERATIONS FUNCTIONS
+*/
+AsyncMatrixOperations::AsyncMatrixOperations(ThreadPool& pool) : pool(pool) {}
+
+AsyncMatrixOperations::~AsyncMatrixOperations() {
+    waitAll();
+}
+
+MatrixFuture AsyncMatrixOperations::run(std::function<double()> operation, const std::vector<MatrixFuture>& after) {
+    auto node = std::make_shared<Node>();
+    node->pool = &pool;
+    node->work = std::move(operation);
+    node->result = node->promise.get_future().share();
+
+    // Link to every input that has not finished yet
+    for (const MatrixFuture& input : after) {
+        if (!input.node) {
+            throw std::future_error(std::future_errc::no_state);
+        }
+        std::lock_guard<std::mutex> lock(input.node->mutex);
+        if (!input.node->finished) {
+            input.node->dependents.push_back(node);
+            node->pending++;
+        }
+        node->inputs.push_back(input.node);
+    }
+
+    MatrixFuture future;
+    future.node = node;
+    {
+        std::lock_guard<std::mutex> lock(scheduledMutex);
+        scheduled.push_back(future);
+    }
+
+    // Drop the scheduler's count; if every input had already finished the node starts now
+    if (node->pending.fetch_sub(1) == 1) {
+        launch(node);
+    }
+    return future;
+}
+
+MatrixFuture AsyncMatrixOperations::add(const Matrix& left, const Matrix& right, Matrix& result,
+                                        const std::vector<MatrixFuture>& after, SumMode mode) {
+    if (left.rows() != right.rows() || left.cols() != right.cols()
+        || left.rows() != result.rows() || left.cols() != result.cols()) {
+        throw std::invalid_argument("Matrix dimensions do not match");
+    }
+    ThreadPool* addPool = &pool;
+    return run([&left, &right, &result, addPool, mode]() {
+        return MatrixOperations::threadedMatrixAdd(left, right, result, *addPool, mode);
+    }, after);
+}
+
+void AsyncMatrixOperations::waitAll() {
+    std::vector<MatrixFuture> waiting;
+    {
+        std::lock_guard<std::mutex> lock(scheduledMutex);
+        waiting.swap(scheduled);
+    }
+    for (const MatrixFuture& future : waiting) {
+        future.wait();
+    }
+}
+
+void AsyncMatrixOperations::launch(const std::shared_ptr<Node>& node) {
+    node->pool->submit([node]() {
+        // A failed input fails this operation too, without running it
+        for (const std::shared_ptr<Node>& input : node->inputs) {
+            std::lock_guard<std::mutex> lock(input->mutex);
+            if (input->error && !node->error) {
+                node->error = input->error;
+            }
+        }
+        node->inputs.clear();
+
+        double value = 0.0;
+        if (!node->error) {
+            try {
+                value = node->work();
+            } catch (...) {
+                node->error = std::current_exception();
+            }
+        }
+        node->work = nullptr;
+
+        // Dependents are launched before the promise is set, so once every future is ready
+        // nothing is left touching the scheduler
+        finish(node);
+        if (node->error) {
+            node->promise.set_exception(node->error);
+        } else {
+            node->promise.set_value(value);
+        }
+    });
+}
+
+void AsyncMatrixOperations::finish(const std::shared_ptr<Node>& node) {
+    std::vector<std::shared_ptr<Node>> ready;
+    {
+        std::lock_guard<std::mutex> lock(node->mutex);
+        node->finished = true;
+        ready.swap(node->dependents);
+    }
+    for (const std::shared_ptr<Node>& dependent : ready) {
+        if (dependent->pending.fetch_sub(1) == 1) {
+            launch(dependent);
+        }
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "MatrixOperations.h"
+#include "ThreadPool.h"
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Result of one operation scheduled on AsyncMatrixOperations. Copies share the same result,
+// like std::shared_future, and can be passed as dependencies of later operations.
+class MatrixFuture {
+    public:
+        MatrixFuture() = default;
+
+        // Whether this refers to a scheduled operation
+        bool valid() const;
+
+        // Whether the operation has finished (successfully or not)
+        bool ready() const;
+
+        // Block until the operation has finished, running other queued tasks meanwhile
+        void wait() const;
+
+        // Wait and return the operation's result, rethrowing any exception it threw
+        double get() const;
+
+        // The underlying std::shared_future, for code that waits on standard futures
+        std::shared_future<double> share() const;
+
+    private:
+        friend class AsyncMatrixOperations;
+        struct Node;
+        std::shared_ptr<Node> node;
+};
+
+// Schedules matrix operations on a thread pool without waiting for them. Each operation returns
+// a MatrixFuture and may list the futures it depends on: it is queued as soon as the last of
+// them finishes, so independent operations overlap and a chain of dependent ones never waits
+// for a join. If a dependency throws, the operations after it are skipped and rethrow its exception.
+//
+// Matrices are held by reference and must outlive the operations that use them.
+class AsyncMatrixOperations {
+    public:
+        explicit AsyncMatrixOperations(ThreadPool& pool);
+
+        // Waits for every operation still scheduled
+        ~AsyncMatrixOperations();
+
+        AsyncMatrixOperations(const AsyncMatrixOperations&) = delete;
+        AsyncMatrixOperations& operator=(const AsyncMatrixOperations&) = delete;
+
+        // Run operation() once every future in after is ready; the future holds its return value
+        MatrixFuture run(std::function<double()> operation, const std::vector<MatrixFuture>& after = {});
+
+        // result = left + right once every future in after is ready; the future holds the sum of result
+        MatrixFuture add(const Matrix& left, const Matrix& right, Matrix& result,
+                         const std::vector<MatrixFuture>& after = {}, SumMode mode = SumMode::FAST);
+
+        // Block until every operation scheduled so far has finished (exceptions stay in their futures)
+        void waitAll();
+
+    private:
+        using Node = MatrixFuture::Node;
+
+        // Queue a node whose dependencies have all finished
+        static void launch(const std::shared_ptr<Node>& node);
+
+        // Mark node finished and launch any dependents that were only waiting for it
+        static void finish(const std::shared_ptr<Node>& node);
+
+        ThreadPool& pool;
+        std::mutex scheduledMutex;
+        std::vector<MatrixFuture> scheduled;
+};
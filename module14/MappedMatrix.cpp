@@ -0,0 +1,173 @@
+#include "MappedMatrix.h"
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// First bytes of every matrix file
+static const char MAGIC[8] = {'M', 'A', 'T', 'R', 'I', 'X', '0', '1'};
+
+// Layout of the start of the header page
+struct MappedMatrixHeader {
+    char magic[8];
+    std::int64_t rows;
+    std::int64_t cols;
+};
+
+// Throws a runtime_error naming the failed call and the OS error
+static void throwSystemError(const std::string& what, const std::string& path) {
+    throw std::runtime_error(what + " failed for " + path + ": " + std::strerror(errno));
+}
+
+// Maps a whole file, closing the descriptor once the mapping exists
+static void* mapFile(int fd, long bytes, bool writable, const std::string& path) {
+    int protection = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    void* mapping = mmap(nullptr, bytes, protection, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        throwSystemError("mmap", path);
+    }
+    return mapping;
+}
+
+MappedMatrix MappedMatrix::create(const std::string& path, int rows, int cols) {
+    if (rows < 0 || cols < 0) {
+        throw std::invalid_argument("Matrix dimensions must not be negative");
+    }
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throwSystemError("open", path);
+    }
+
+    // Extending the file leaves a hole, so the zeros take no disk space until written
+    long bytes = HEADER_BYTES + static_cast<long>(rows) * cols * static_cast<long>(sizeof(double));
+    if (ftruncate(fd, bytes) != 0) {
+        close(fd);
+        throwSystemError("ftruncate", path);
+    }
+
+    void* mapping = mapFile(fd, bytes, true, path);
+    MappedMatrixHeader* header = static_cast<MappedMatrixHeader*>(mapping);
+    std::memcpy(header->magic, MAGIC, sizeof(MAGIC));
+    header->rows = rows;
+    header->cols = cols;
+    return MappedMatrix(mapping, bytes, rows, cols, true);
+}
+
+MappedMatrix MappedMatrix::open(const std::string& path, bool writable) {
+    int fd = ::open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+        throwSystemError("open", path);
+    }
+
+    MappedMatrixHeader header;
+    if (pread(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))
+        || std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0
+        || header.rows < 0 || header.cols < 0 || header.rows > INT_MAX || header.cols > INT_MAX) {
+        close(fd);
+        throw std::runtime_error("Not a matrix file: " + path);
+    }
+
+    // Both dimensions fit in an int, so their product cannot overflow 64 bits
+    long fileBytes = lseek(fd, 0, SEEK_END);
+    if (fileBytes < HEADER_BYTES
+        || header.rows * header.cols > (fileBytes - HEADER_BYTES) / static_cast<long>(sizeof(double))) {
+        close(fd);
+        throw std::runtime_error("Matrix file is truncated: " + path);
+    }
+
+    long bytes = HEADER_BYTES + header.rows * header.cols * static_cast<long>(sizeof(double));
+    void* mapping = mapFile(fd, bytes, writable, path);
+    return MappedMatrix(mapping, bytes, static_cast<int>(header.rows), static_cast<int>(header.cols), writable);
+}
+
+MappedMatrix::MappedMatrix(void* mapping, long mappedBytes, int rows, int cols, bool writable)
+    : mapping(mapping), mappedBytes(mappedBytes), numRows(rows), numCols(cols), writableMapping(writable),
+      elements(reinterpret_cast<double*>(static_cast<char*>(mapping) + HEADER_BYTES)) {}
+
+MappedMatrix::MappedMatrix(MappedMatrix&& other) noexcept
+    : mapping(other.mapping), mappedBytes(other.mappedBytes),
+      numRows(other.numRows), numCols(other.numCols), writableMapping(other.writableMapping),
+      elements(other.elements) {
+    other.mapping = nullptr;
+    other.elements = nullptr;
+}
+
+MappedMatrix& MappedMatrix::operator=(MappedMatrix&& other) noexcept {
+    if (this != &other) {
+        if (mapping) {
+            munmap(mapping, mappedBytes);
+        }
+        mapping = other.mapping;
+        mappedBytes = other.mappedBytes;
+        numRows = other.numRows;
+        numCols = other.numCols;
+        writableMapping = other.writableMapping;
+        elements = other.elements;
+        other.mapping = nullptr;
+        other.elements = nullptr;
+    }
+    return *this;
+}
+
+MappedMatrix::~MappedMatrix() {
+    // Unmapping does not lose data: dirty pages of a shared mapping are written back by the OS
+    if (mapping) {
+        munmap(mapping, mappedBytes);
+    }
+}
+
+void MappedMatrix::willNeed(int firstRow, int lastRow) const {
+    char* start;
+    long length;
+    rowPages(firstRow, lastRow, start, length);
+    if (length > 0) {
+        madvise(start, length, MADV_WILLNEED);
+    }
+}
+
+void MappedMatrix::doneWith(int firstRow, int lastRow) const {
+    char* start;
+    long length;
+    rowPages(firstRow, lastRow, start, length);
+    if (length > 0) {
+        madvise(start, length, MADV_DONTNEED);
+    }
+}
+
+void MappedMatrix::flush(int firstRow, int lastRow) const {
+    char* start;
+    long length;
+    rowPages(firstRow, lastRow, start, length);
+    if (length > 0) {
+        msync(start, length, MS_ASYNC);
+    }
+}
+
+void MappedMatrix::rowPages(int firstRow, int lastRow, char*& start, long& length) const {
+    if (firstRow < 0) {
+        firstRow = 0;
+    }
+    if (lastRow >= numRows) {
+        lastRow = numRows - 1;
+    }
+    if (lastRow < firstRow) {
+        start = nullptr;
+        length = 0;
+        return;
+    }
+
+    // madvise and msync take page-aligned addresses
+    long pageSize = sysconf(_SC_PAGESIZE);
+    long begin = HEADER_BYTES + static_cast<long>(firstRow) * numCols * static_cast<long>(sizeof(double));
+    long end = HEADER_BYTES + static_cast<long>(lastRow + 1) * numCols * static_cast<long>(sizeof(double));
+    begin -= begin % pageSize;
+    start = static_cast<char*>(mapping) + begin;
+    length = end - begin;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+
+// Row-major matrix of doubles stored in a binary file and memory-mapped (POSIX only).
+// The file is a one-page header followed by the elements, so rows start page-aligned
+// and the matrix can be larger than physical memory: the OS pages rows in and out.
+class MappedMatrix {
+    public:
+        // Size of the file header; elements start at this offset
+        static const long HEADER_BYTES = 4096;
+
+        // Create (or truncate) a file holding a rows x cols matrix of zeros
+        static MappedMatrix create(const std::string& path, int rows, int cols);
+
+        // Map an existing matrix file, read-only unless writable is set
+        static MappedMatrix open(const std::string& path, bool writable = false);
+
+        MappedMatrix(MappedMatrix&& other) noexcept;
+        MappedMatrix& operator=(MappedMatrix&& other) noexcept;
+        MappedMatrix(const MappedMatrix&) = delete;
+        MappedMatrix& operator=(const MappedMatrix&) = delete;
+        ~MappedMatrix();
+
+        int rows() const { return numRows; }
+        int cols() const { return numCols; }
+        bool writable() const { return writableMapping; }
+        const double* row(int row) const { return elements + static_cast<long>(row) * numCols; }
+
+        // Throws if the file was opened read-only, where writing through the pointer would fault
+        double* row(int row) {
+            if (!writableMapping) {
+                throw std::logic_error("Matrix file is mapped read-only");
+            }
+            return elements + static_cast<long>(row) * numCols;
+        }
+
+        // Paging hints for rows [firstRow, lastRow]
+        void willNeed(int firstRow, int lastRow) const;   // start reading them in now
+        void doneWith(int firstRow, int lastRow) const;   // drop them from this mapping
+
+        // Start writing rows [firstRow, lastRow] back to the file without waiting
+        void flush(int firstRow, int lastRow) const;
+
+    private:
+        MappedMatrix(void* mapping, long mappedBytes, int rows, int cols, bool writable);
+
+        // Page-aligned byte range covering rows [firstRow, lastRow]
+        void rowPages(int firstRow, int lastRow, char*& start, long& length) const;
+
+        void* mapping;
+        long mappedBytes;
+        int numRows;
+        int numCols;
+        bool writableMapping;
+        double* elements;
+};
@@ -0,0 +1,481 @@
+#pragma once
+
+#include "MatrixOperations.h"
+#include "Precision.h"
+#include "RowKernels.h"
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+// Base of every lazy matrix expression (CRTP). Nothing is computed until the
+// expression is assigned to a Matrix, which then evaluates all of it in one pass.
+template <typename E>
+class MatrixExpression {
+    public:
+        const E& self() const { return static_cast<const E&>(*this); }
+        int rows() const { return self().rows(); }
+        int cols() const { return self().cols(); }
+        auto at(int row, int col) const { return self().at(row, col); }
+
+        // Whether every operand steps through memory one element at a time along a row.
+        // If not, assignment walks the result in square tiles so strided reads stay in cache.
+        bool rowContiguous() const { return self().rowContiguous(); }
+
+        // Whether some operand reads storage in [begin, end) other than element for element as a
+        // row-major matrix with rowStride elements per row. Writing such a matrix in place would
+        // change elements the expression has yet to read.
+        bool aliases(const void* begin, const void* end, long rowStride) const {
+            return self().aliases(begin, end, rowStride);
+        }
+};
+
+template <typename T>
+class MatrixView;
+
+// Row-major dense matrix on the heap, rows aligned for the SIMD row kernels.
+// T is the storage type (double, float or BFloat16); elements are read as Precision<T>::Compute.
+template <typename T>
+class BasicMatrix : public MatrixExpression<BasicMatrix<T>> {
+    public:
+        using Compute = typename Precision<T>::Compute;
+
+        // Elements start at zero, written on the shared pool so pages are first touched
+        // by the threads that will later process them
+        BasicMatrix(int rows, int cols);
+
+        BasicMatrix(const BasicMatrix& other);
+        BasicMatrix(BasicMatrix&& other) noexcept = default;
+        BasicMatrix& operator=(const BasicMatrix& other);
+        BasicMatrix& operator=(BasicMatrix&& other) noexcept = default;
+
+        // Evaluate an expression such as A + B + C * 2.0 in a single threaded pass, no temporaries
+        template <typename E>
+        BasicMatrix(const MatrixExpression<E>& expression);
+
+        template <typename E>
+        BasicMatrix& operator=(const MatrixExpression<E>& expression);
+
+        // Same as operator= on a caller-owned pool
+        template <typename E>
+        void assign(const MatrixExpression<E>& expression, ThreadPool& pool);
+
+        int rows() const { return numRows; }
+        int cols() const { return numCols; }
+        Compute at(int row, int col) const { return elements[static_cast<long>(row) * numCols + col]; }
+        T& at(int row, int col) { return elements[static_cast<long>(row) * numCols + col]; }
+        const T* row(int row) const { return elements.get() + static_cast<long>(row) * numCols; }
+        T* row(int row) { return elements.get() + static_cast<long>(row) * numCols; }
+        bool rowContiguous() const { return true; }
+        bool aliases(const void* begin, const void* end, long rowStride) const {
+            return view().aliases(begin, end, rowStride);
+        }
+
+        // Read-only view of all elements, to be transposed, sliced or blocked without copying
+        MatrixView<T> view() const;
+
+        // Rows per pool task for this element type (see MatrixOperations::rowsPerChunk)
+        static int rowsPerChunk(int cols) { return MatrixOperations::rowsPerChunk(cols, sizeof(T)); }
+
+    private:
+        struct AlignedDelete {
+            void operator()(T* data) const { ::operator delete[](data, std::align_val_t(64)); }
+        };
+
+        static std::unique_ptr<T[], AlignedDelete> allocate(long count);
+
+        int numRows;
+        int numCols;
+        std::unique_ptr<T[], AlignedDelete> elements;
+};
+
+// The default double-precision matrix
+using Matrix = BasicMatrix<double>;
+
+// Read-only strided view of matrix elements: element (row, col) is at
+// data[row * rowStride + col * colStride]. Transposes, sub-blocks and row or column slices
+// are all views of the same storage, so A + transpose(B) reads B in place with no copy.
+// The viewed matrix must outlive the view.
+template <typename T>
+class MatrixView : public MatrixExpression<MatrixView<T>> {
+    public:
+        using Compute = typename Precision<T>::Compute;
+
+        MatrixView(const T* data, int rows, int cols, long rowStride, long colStride)
+            : data(data), numRows(rows), numCols(cols), rowStride(rowStride), colStride(colStride) {}
+
+        int rows() const { return numRows; }
+        int cols() const { return numCols; }
+        Compute at(int row, int col) const { return data[row * rowStride + col * colStride]; }
+        bool rowContiguous() const { return colStride == 1 || numCols <= 1; }
+
+        bool aliases(const void* begin, const void* end, long stride) const {
+            if (numRows == 0 || numCols == 0) {
+                return false;
+            }
+            if (data == begin && rowStride == stride && rowContiguous()) {
+                return false;
+            }
+            const T* last = data + (numRows - 1) * rowStride + (numCols - 1) * colStride;
+            std::less<const void*> before;
+            return before(begin, end) && before(data, end) && !before(last, begin);
+        }
+
+        // Element (0, 0) and the distance in elements between neighbouring rows and columns
+        const T* origin() const { return data; }
+        long rowStep() const { return rowStride; }
+        long colStep() const { return colStride; }
+
+        // The same elements with rows and columns swapped
+        MatrixView transposed() const { return MatrixView(data, numCols, numRows, colStride, rowStride); }
+
+        // The rows x cols block whose top-left element is (firstRow, firstCol)
+        MatrixView block(int firstRow, int firstCol, int rows, int cols) const {
+            if (firstRow < 0 || firstCol < 0 || rows < 0 || cols < 0
+                || firstRow + rows > numRows || firstCol + cols > numCols) {
+                throw std::out_of_range("Block outside the matrix");
+            }
+            return MatrixView(data + firstRow * rowStride + firstCol * colStride, rows, cols, rowStride, colStride);
+        }
+
+        // Row `row` as a 1 x cols view, column `col` as a rows x 1 view
+        MatrixView rowSlice(int row) const { return block(row, 0, 1, numCols); }
+        MatrixView columnSlice(int col) const { return block(0, col, numRows, 1); }
+
+    private:
+        const T* data;
+        int numRows;
+        int numCols;
+        long rowStride;
+        long colStride;
+};
+
+// Views of a whole matrix
+template <typename T>
+MatrixView<T> transpose(const BasicMatrix<T>& matrix) {
+    return matrix.view().transposed();
+}
+
+template <typename T>
+MatrixView<T> transpose(const MatrixView<T>& view) {
+    return view.transposed();
+}
+
+template <typename T>
+MatrixView<T> block(const BasicMatrix<T>& matrix, int firstRow, int firstCol, int rows, int cols) {
+    return matrix.view().block(firstRow, firstCol, rows, cols);
+}
+
+template <typename T>
+MatrixView<T> rowSlice(const BasicMatrix<T>& matrix, int row) {
+    return matrix.view().rowSlice(row);
+}
+
+template <typename T>
+MatrixView<T> columnSlice(const BasicMatrix<T>& matrix, int col) {
+    return matrix.view().columnSlice(col);
+}
+
+// How an operand is held inside an expression: matrices by reference, sub-expressions by value
+template <typename E>
+struct ExpressionOperand {
+    using type = const E;
+};
+
+template <typename T>
+struct ExpressionOperand<BasicMatrix<T>> {
+    using type = const BasicMatrix<T>&;
+};
+
+// Throws if two operands of an element-wise operation have different shapes
+template <typename L, typename R>
+void checkSameShape(const MatrixExpression<L>& left, const MatrixExpression<R>& right) {
+    if (left.rows() != right.rows() || left.cols() != right.cols()) {
+        throw std::invalid_argument("Matrix dimensions do not match");
+    }
+}
+
+// left + right
+template <typename L, typename R>
+class MatrixSum : public MatrixExpression<MatrixSum<L, R>> {
+    public:
+        MatrixSum(const L& l, const R& r) : left(l), right(r) { checkSameShape(l, r); }
+        int rows() const { return left.rows(); }
+        int cols() const { return left.cols(); }
+        auto at(int row, int col) const { return left.at(row, col) + right.at(row, col); }
+        bool rowContiguous() const { return left.rowContiguous() && right.rowContiguous(); }
+        bool aliases(const void* begin, const void* end, long rowStride) const {
+            return left.aliases(begin, end, rowStride) || right.aliases(begin, end, rowStride);
+        }
+    private:
+        typename ExpressionOperand<L>::type left;
+        typename ExpressionOperand<R>::type right;
+};
+
+// left - right
+template <typename L, typename R>
+class MatrixDifference : public MatrixExpression<MatrixDifference<L, R>> {
+    public:
+        MatrixDifference(const L& l, const R& r) : left(l), right(r) { checkSameShape(l, r); }
+        int rows() const { return left.rows(); }
+        int cols() const { return left.cols(); }
+        auto at(int row, int col) const { return left.at(row, col) - right.at(row, col); }
+        bool rowContiguous() const { return left.rowContiguous() && right.rowContiguous(); }
+        bool aliases(const void* begin, const void* end, long rowStride) const {
+            return left.aliases(begin, end, rowStride) || right.aliases(begin, end, rowStride);
+        }
+    private:
+        typename ExpressionOperand<L>::type left;
+        typename ExpressionOperand<R>::type right;
+};
+
+// operand * scalar, with the scalar converted to the operand's type so float
+// expressions are not silently promoted to double
+template <typename E>
+class ScaledMatrix : public MatrixExpression<ScaledMatrix<E>> {
+    public:
+        ScaledMatrix(const E& e, double s) : operand(e), scalar(s) {}
+        int rows() const { return operand.rows(); }
+        int cols() const { return operand.cols(); }
+        auto at(int row, int col) const {
+            auto value = operand.at(row, col);
+            return value * static_cast<decltype(value)>(scalar);
+        }
+        bool rowContiguous() const { return operand.rowContiguous(); }
+        bool aliases(const void* begin, const void* end, long rowStride) const {
+            return operand.aliases(begin, end, rowStride);
+        }
+    private:
+        typename ExpressionOperand<E>::type operand;
+        double scalar;
+};
+
+template <typename L, typename R>
+MatrixSum<L, R> operator+(const MatrixExpression<L>& left, const MatrixExpression<R>& right) {
+    return MatrixSum<L, R>(left.self(), right.self());
+}
+
+template <typename L, typename R>
+MatrixDifference<L, R> operator-(const MatrixExpression<L>& left, const MatrixExpression<R>& right) {
+    return MatrixDifference<L, R>(left.self(), right.self());
+}
+
+template <typename E>
+ScaledMatrix<E> operator*(const MatrixExpression<E>& operand, double scalar) {
+    return ScaledMatrix<E>(operand.self(), scalar);
+}
+
+template <typename E>
+ScaledMatrix<E> operator*(double scalar, const MatrixExpression<E>& operand) {
+    return ScaledMatrix<E>(operand.self(), scalar);
+}
+
+template <typename E>
+ScaledMatrix<E> operator-(const MatrixExpression<E>& operand) {
+    return ScaledMatrix<E>(operand.self(), -1.0);
+}
+
+/*
+BASICMATRIX FUNCTIONS
+*/
+template <typename T>
+BasicMatrix<T>::BasicMatrix(int rows, int cols) : numRows(rows), numCols(cols) {
+    if (rows < 0 || cols < 0) {
+        throw std::invalid_argument("Matrix dimensions must not be negative");
+    }
+    elements = allocate(static_cast<long>(rows) * cols);
+
+    // Zero in the same row chunks the expression evaluation uses (first touch)
+    MatrixOperations::sharedPool().parallelForStatic(0, numRows - 1, rowsPerChunk(numCols), [this](int startRow, int endRow) {
+        std::fill(row(startRow), row(endRow) + numCols, T(0.0f));
+    });
+}
+
+template <typename T>
+BasicMatrix<T>::BasicMatrix(const BasicMatrix& other)
+    : numRows(other.numRows), numCols(other.numCols),
+      elements(allocate(static_cast<long>(other.numRows) * other.numCols)) {
+    std::copy(other.row(0), other.row(0) + static_cast<long>(numRows) * numCols, row(0));
+}
+
+template <typename T>
+BasicMatrix<T>& BasicMatrix<T>::operator=(const BasicMatrix& other) {
+    if (this != &other) {
+        if (numRows != other.numRows || numCols != other.numCols) {
+            numRows = other.numRows;
+            numCols = other.numCols;
+            elements = allocate(static_cast<long>(numRows) * numCols);
+        }
+        std::copy(other.row(0), other.row(0) + static_cast<long>(numRows) * numCols, row(0));
+    }
+    return *this;
+}
+
+template <typename T>
+template <typename E>
+BasicMatrix<T>::BasicMatrix(const MatrixExpression<E>& expression)
+    : numRows(expression.rows()), numCols(expression.cols()),
+      elements(allocate(static_cast<long>(expression.rows()) * expression.cols())) {
+    assign(expression, MatrixOperations::sharedPool());
+}
+
+template <typename T>
+template <typename E>
+BasicMatrix<T>& BasicMatrix<T>::operator=(const MatrixExpression<E>& expression) {
+    assign(expression, MatrixOperations::sharedPool());
+    return *this;
+}
+
+template <typename T>
+template <typename E>
+void BasicMatrix<T>::assign(const MatrixExpression<E>& expression, ThreadPool& pool) {
+    if (expression.rows() != numRows || expression.cols() != numCols) {
+        throw std::invalid_argument("Matrix dimensions do not match");
+    }
+
+    // An operand that reads this matrix other than element for element, such as transpose(*this),
+    // would see results already written: evaluate into a new matrix and move it in
+    const T* begin = elements.get();
+    if (expression.aliases(begin, begin + static_cast<long>(numRows) * numCols, numCols)) {
+        BasicMatrix result(numRows, numCols);
+        result.assign(expression, pool);
+        *this = std::move(result);
+        return;
+    }
+
+    // A bare strided view is a copy, done by the cache-oblivious recursion
+    if constexpr (std::is_same<E, MatrixView<T>>::value) {
+        if (!expression.rowContiguous()) {
+            MatrixOperations::copy(expression.self(), *this, pool);
+            return;
+        }
+    }
+
+    // Each element depends only on the same element of the operands, so writing
+    // in place is safe even when this matrix also appears in the expression
+    const E& fused = expression.self();
+    if (fused.rowContiguous()) {
+        pool.parallelFor(0, numRows - 1, rowsPerChunk(numCols), [&](int startRow, int endRow) {
+            for (int r = startRow; r <= endRow; r++) {
+                T* out = row(r);
+                for (int c = 0; c < numCols; c++) {
+                    out[c] = static_cast<T>(static_cast<Compute>(fused.at(r, c)));
+                }
+            }
+        });
+        return;
+    }
+
+    // Some operand is read down columns: walk TILE_SIZE x TILE_SIZE tiles so each cache line
+    // of a strided operand is used for a whole tile of rows before it is evicted
+    pool.parallelFor(0, numRows - 1, TILE_SIZE, [&](int startRow, int endRow) {
+        for (int firstCol = 0; firstCol < numCols; firstCol += TILE_SIZE) {
+            int lastCol = std::min(firstCol + TILE_SIZE, numCols);
+            for (int r = startRow; r <= endRow; r++) {
+                T* out = row(r);
+                for (int c = firstCol; c < lastCol; c++) {
+                    out[c] = static_cast<T>(static_cast<Compute>(fused.at(r, c)));
+                }
+            }
+        }
+    });
+}
+
+template <typename T>
+MatrixView<T> BasicMatrix<T>::view() const {
+    return MatrixView<T>(elements.get(), numRows, numCols, numCols, 1);
+}
+
+// Cache-line aligned storage; pages are not touched until first written
+template <typename T>
+std::unique_ptr<T[], typename BasicMatrix<T>::AlignedDelete> BasicMatrix<T>::allocate(long count) {
+    void* data = ::operator new[](std::max(count, 1L) * sizeof(T), std::align_val_t(64));
+    return std::unique_ptr<T[], AlignedDelete>(static_cast<T*>(data));
+}
+
+/*
+TRANSPOSE AND STRIDED COPY
+*/
+// Copies the rows x cols block of source starting at (firstRow, firstCol) into the same
+// place in result, halving the longer side until the block fits in cache. No tile size is
+// tuned: at some depth of the recursion both the source and result blocks fit in each cache level.
+template <typename T>
+void copyViewBlock(const MatrixView<T>& source, BasicMatrix<T>& result,
+                      int firstRow, int firstCol, int rows, int cols) {
+    if (static_cast<long>(rows) * cols <= COPY_BLOCK_ELEMENTS) {
+        for (int r = firstRow; r < firstRow + rows; r++) {
+            T* out = result.row(r);
+            const T* in = source.origin() + r * source.rowStep();
+            for (int c = firstCol; c < firstCol + cols; c++) {
+                out[c] = in[c * source.colStep()];
+            }
+        }
+    } else if (rows >= cols) {
+        copyViewBlock(source, result, firstRow, firstCol, rows / 2, cols);
+        copyViewBlock(source, result, firstRow + rows / 2, firstCol, rows - rows / 2, cols);
+    } else {
+        copyViewBlock(source, result, firstRow, firstCol, rows, cols / 2);
+        copyViewBlock(source, result, firstRow, firstCol + cols / 2, rows, cols - cols / 2);
+    }
+}
+
+template <typename T>
+void MatrixOperations::copy(const MatrixView<T>& source, BasicMatrix<T>& result, ThreadPool& pool) {
+    if (source.rows() != result.rows() || source.cols() != result.cols()) {
+        throw std::invalid_argument("Matrix dimensions do not match");
+    }
+    if (source.rows() == 0 || source.cols() == 0) {
+        return;
+    }
+
+    // A few bands of result rows per thread, each copied by the recursion
+    int bandRows = std::max(TILE_SIZE, source.rows() / (pool.size() * 4));
+    pool.parallelFor(0, source.rows() - 1, bandRows, [&](int startRow, int endRow) {
+        copyViewBlock(source, result, startRow, 0, endRow - startRow + 1, source.cols());
+    });
+}
+
+template <typename T>
+void MatrixOperations::transpose(const BasicMatrix<T>& source, BasicMatrix<T>& result, ThreadPool& pool) {
+    if (&source == &result) {
+        throw std::invalid_argument("Transpose cannot be done in place");
+    }
+    copy(source.view().transposed(), result, pool);
+}
+
+/*
+REDUCED-PRECISION MATRIX OPERATIONS
+*/
+template <typename T>
+double MatrixOperations::threadedMatrixAdd(const BasicMatrix<T>& left, const BasicMatrix<T>& right,
+                                           BasicMatrix<T>& result, ThreadPool& pool) {
+    using Accumulate = typename Precision<T>::Accumulate;
+
+    if (left.rows() != right.rows() || left.cols() != right.cols()
+        || left.rows() != result.rows() || left.cols() != result.cols()) {
+        throw std::invalid_argument("Matrix dimensions do not match");
+    }
+
+    int numCols = left.cols();
+    int chunkRows = BasicMatrix<T>::rowsPerChunk(numCols);
+    bool streamStores = static_cast<long>(sizeof(T)) * left.rows() * numCols > STREAM_RESULT_BYTES;
+    std::vector<Accumulate> chunkSums((left.rows() + chunkRows - 1) / chunkRows);
+
+    pool.parallelFor(0, left.rows() - 1, chunkRows, [&](int startRow, int endRow) {
+        Accumulate sum = 0;
+        for (int row = startRow; row <= endRow; row++) {
+            sum += addRowPrecision(left.row(row), right.row(row), result.row(row), numCols, streamStores);
+        }
+        chunkSums[startRow / chunkRows] = sum;
+    });
+
+    // Chunks are combined in double whatever the accumulation type
+    KahanSum total;
+    for (Accumulate chunkSum : chunkSums) {
+        total.add(chunkSum);
+    }
+    return total.result();
+}
@@ -1,125 +1,185 @@
+#include "AsyncMatrixOperations.h"
+#include "MappedMatrix.h"
+#include "Matrix.h"
+#include "MatrixOperations.h"
+#include "SparseMatrix.h"
+#include "RowKernels.h"
 #include <iostream>
 #include <thread>
-#include <vector>
 #include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <vector>
 using namespace std;
 
-const int NUM_ROWS = 9000;
-const int NUM_COLS = 9000;
-
-class MatrixOperations {
-    public:
-        // Add two matrices returning the sum of all elements of the result
-        static inline void matrixAdd(double leftMatrix[NUM_ROWS][NUM_COLS],
-                            double rightMatrix[NUM_ROWS][NUM_COLS],
-                            double resultMatrix[NUM_ROWS][NUM_COLS],
-                            int startRow,
-                            int endRow,
-                            double &sum) {
-            sum = 0;
-
-            for (int row = startRow; row <= endRow; row++) {
-                addRow(leftMatrix[row], rightMatrix[row], resultMatrix[row], NUM_COLS, sum);
-            }
-        } // end matrixAdd
-    
-        static void threadedMatrixAdd(double leftMatrix[NUM_ROWS][NUM_COLS],
-                                    double rightMatrix[NUM_ROWS][NUM_COLS],
-                                    double resultMatrix[NUM_ROWS][NUM_COLS],
-                                    double sum,
-                                    int numThreads) {
-
-            if (numThreads <= 0) {
-                numThreads = 4;
-            }
-
-            // Use fixed-size arrays 
-            std::thread threads[numThreads];
-            double threadSums[numThreads];
-
-            // Initialize sums
-            for (int i = 0; i < numThreads; i++) {
-                threadSums[i] = 0.0;
-            }
-
-            int rowsPerThread = NUM_ROWS / numThreads;
-
-            // Launch threads
-            for (int t = 0; t < numThreads; t++) {
-                int startRow = t * rowsPerThread;
-                int endRow = (t == numThreads - 1) ? NUM_ROWS - 1 : startRow + rowsPerThread - 1;
-
-                threads[t] = std::thread(
-                    matrixAdd,
-                    leftMatrix,
-                    rightMatrix,
-                    resultMatrix,
-                    startRow,
-                    endRow,
-                    std::ref(threadSums[t])
-                );
-            }
-
-            // Join threads
-            for (int t = 0; t < numThreads; t++) {
-                threads[t].join();
-            }
-
-            // Combine sums
-            for (int i = 0; i < numThreads; i++) {
-                sum += threadSums[i];
-            }
-        }
-
-    private:
-        // Inline helper for adding a single row 
-        static inline void addRow(const double* left, const double* right, double* result, int numCols, double &sum) {
-            for (int col = 0; col < numCols; col++) {
-                double value = left[col] + right[col];
-                result[col] = value;
-                sum += value;
-            }
-        }
-};
-
-
-
-
 // Main function for running programs
 int main(void) {
-    static double matrix1[NUM_ROWS][NUM_COLS];
-    static double matrix2[NUM_ROWS][NUM_COLS];
-    static double unthreadedResult[NUM_ROWS][NUM_COLS]; // unthreaded result
-    static double threadedResult[NUM_ROWS][NUM_COLS]; // threaded result
+    // On the heap: 2.6 GB of static arrays would not link with the default code model.
+    // Left uninitialized, so each page is first touched by the worker that fills it
+    unique_ptr<double[][NUM_COLS]> matrix1(new double[NUM_ROWS][NUM_COLS]);
+    unique_ptr<double[][NUM_COLS]> matrix2(new double[NUM_ROWS][NUM_COLS]);
+    unique_ptr<double[][NUM_COLS]> unthreadedResult(new double[NUM_ROWS][NUM_COLS]); // unthreaded result
+    unique_ptr<double[][NUM_COLS]> threadedResult(new double[NUM_ROWS][NUM_COLS]); // threaded result
+
+    // Start worker threads once, outside the timing
+    int numThreads = std::thread::hardware_concurrency();
+    ThreadPool& pool = MatrixOperations::sharedPool(numThreads);
 
-    // Initialize matrices
-    for (int i = 0; i < NUM_ROWS; i++) {
-        for (int j = 0; j < NUM_COLS; j++) {
-            matrix1[i][j] = i + j;
-            matrix2[i][j] = i - j;
-        }
-    }
+    // Initialize matrices in parallel so their pages are spread over the workers' NUMA nodes
+    MatrixOperations::parallelFill(matrix1.get(), pool, [](int i, int j) { return double(i + j); });
+    MatrixOperations::parallelFill(matrix2.get(), pool, [](int i, int j) { return double(i - j); });
 
     // UNTHREADED MATRIX ADDITION
-    double unthreadedTotalSum = 0;
     auto startTime1 = chrono::high_resolution_clock::now();
-    MatrixOperations::matrixAdd(matrix1, matrix2, unthreadedResult, 0, NUM_ROWS - 1, unthreadedTotalSum);
+    double unthreadedTotalSum = MatrixOperations::matrixAdd(matrix1.get(), matrix2.get(), unthreadedResult.get(), 0, NUM_ROWS - 1);
     auto endTime1 = chrono::high_resolution_clock::now();
     auto time1 = chrono::duration<double, milli>(endTime1 - startTime1).count();
 
     // THREADED MATRIX ADDITION
-    int numThreads = std::thread::hardware_concurrency();
-    double threadedTotalSum = 0;
     auto startTime2 = chrono::high_resolution_clock::now();
-    MatrixOperations::threadedMatrixAdd(matrix1, matrix2, threadedResult, threadedTotalSum, numThreads);
+    double threadedTotalSum = MatrixOperations::threadedMatrixAdd(matrix1.get(), matrix2.get(), threadedResult.get(), pool);
     auto endTime2 = chrono::high_resolution_clock::now();
     auto time2 = chrono::duration<double, milli>(endTime2 - startTime2).count();
 
+    // COMPENSATED SUMS (threaded and unthreaded should agree exactly)
+    double unthreadedPairwiseSum = MatrixOperations::matrixAdd(matrix1.get(), matrix2.get(), unthreadedResult.get(), 0, NUM_ROWS - 1, SumMode::PAIRWISE);
+    double threadedPairwiseSum = MatrixOperations::threadedMatrixAdd(matrix1.get(), matrix2.get(), threadedResult.get(), pool, SumMode::PAIRWISE);
+
+    // FUSED EXPRESSION (R = A + B + C * 2.0 in one pass, no temporaries)
+    const int EXPR_SIZE = 3000;
+    Matrix a(EXPR_SIZE, EXPR_SIZE), b(EXPR_SIZE, EXPR_SIZE), c(EXPR_SIZE, EXPR_SIZE), r(EXPR_SIZE, EXPR_SIZE);
+    for (int i = 0; i < EXPR_SIZE; i++) {
+        for (int j = 0; j < EXPR_SIZE; j++) {
+            a.at(i, j) = i + j;
+            b.at(i, j) = i - j;
+            c.at(i, j) = j;
+        }
+    }
+    auto startTime3 = chrono::high_resolution_clock::now();
+    r = a + b + c * 2.0;
+    auto endTime3 = chrono::high_resolution_clock::now();
+    auto time3 = chrono::duration<double, milli>(endTime3 - startTime3).count();
+    bool fusedCorrect = true;
+    for (int i = 0; i < EXPR_SIZE; i++) {
+        for (int j = 0; j < EXPR_SIZE; j++) {
+            fusedCorrect = fusedCorrect && r.at(i, j) == 2.0 * i + 2.0 * j;
+        }
+    }
+
+    // TRANSPOSED OPERAND (R = A + B^T read through a strided view, no copy of B)
+    auto startTime6 = chrono::high_resolution_clock::now();
+    r = a + transpose(b);
+    auto endTime6 = chrono::high_resolution_clock::now();
+    auto transposedTime = chrono::duration<double, milli>(endTime6 - startTime6).count();
+    bool transposedCorrect = true;
+    for (int i = 0; i < EXPR_SIZE; i++) {
+        for (int j = 0; j < EXPR_SIZE; j++) {
+            transposedCorrect = transposedCorrect && r.at(i, j) == 2.0 * j;
+        }
+    }
+
+    // ALIASED OPERAND (R = R + R^T reads R through a transposed view while writing it)
+    r = r + transpose(r);
+    bool aliasedCorrect = true;
+    for (int i = 0; i < EXPR_SIZE; i++) {
+        for (int j = 0; j < EXPR_SIZE; j++) {
+            aliasedCorrect = aliasedCorrect && r.at(i, j) == 2.0 * i + 2.0 * j;
+        }
+    }
+
+    // OUT-OF-CORE ADDITION (matrices stored in memory-mapped files)
+    const int MAPPED_SIZE = 3000;
+    string tempDir = filesystem::temp_directory_path().string();
+    double mappedSum = 0;
+    double mappedTime = 0;
+    {
+        MappedMatrix mappedLeft = MappedMatrix::create(tempDir + "/mapped_left.bin", MAPPED_SIZE, MAPPED_SIZE);
+        MappedMatrix mappedRight = MappedMatrix::create(tempDir + "/mapped_right.bin", MAPPED_SIZE, MAPPED_SIZE);
+        MappedMatrix mappedResult = MappedMatrix::create(tempDir + "/mapped_result.bin", MAPPED_SIZE, MAPPED_SIZE);
+        for (int i = 0; i < MAPPED_SIZE; i++) {
+            for (int j = 0; j < MAPPED_SIZE; j++) {
+                mappedLeft.row(i)[j] = i + j;
+                mappedRight.row(i)[j] = i - j;
+            }
+        }
+        auto startTime4 = chrono::high_resolution_clock::now();
+        mappedSum = MatrixOperations::mappedMatrixAdd(mappedLeft, mappedRight, mappedResult, pool, 256);
+        auto endTime4 = chrono::high_resolution_clock::now();
+        mappedTime = chrono::duration<double, milli>(endTime4 - startTime4).count();
+    }
+    remove((tempDir + "/mapped_left.bin").c_str());
+    remove((tempDir + "/mapped_right.bin").c_str());
+    remove((tempDir + "/mapped_result.bin").c_str());
+
+    // SPARSE ADDITION AND MATRIX-VECTOR PRODUCT (tridiagonal matrices, >99% zeros)
+    CooMatrix lowerBand(EXPR_SIZE, EXPR_SIZE), upperBand(EXPR_SIZE, EXPR_SIZE);
+    for (int i = 0; i < EXPR_SIZE; i++) {
+        lowerBand.add(i, i, 2.0);
+        upperBand.add(i, i, 1.0);
+        if (i > 0) {
+            lowerBand.add(i, i - 1, -1.0);
+        }
+        if (i + 1 < EXPR_SIZE) {
+            upperBand.add(i, i + 1, -1.0);
+        }
+    }
+    CsrMatrix sparseSum = CsrMatrix::add(CsrMatrix::fromCoo(lowerBand), CsrMatrix::fromCoo(upperBand), pool);
+    vector<double> ones(EXPR_SIZE, 1.0);
+    vector<double> product = sparseSum.multiply(ones, pool);
+
+    // ASYNCHRONOUS BATCH (many small adds; D = A + B and E = B + C overlap, F = D + E waits for both)
+    const int BATCH_SIZE = 200;
+    const int SMALL_SIZE = 128;
+    Matrix smallA(SMALL_SIZE, SMALL_SIZE), smallB(SMALL_SIZE, SMALL_SIZE), smallC(SMALL_SIZE, SMALL_SIZE);
+    for (int i = 0; i < SMALL_SIZE; i++) {
+        for (int j = 0; j < SMALL_SIZE; j++) {
+            smallA.at(i, j) = i + j;
+            smallB.at(i, j) = i - j;
+            smallC.at(i, j) = j;
+        }
+    }
+    vector<Matrix> batchD, batchE, batchF;
+    for (int i = 0; i < BATCH_SIZE; i++) {
+        batchD.emplace_back(SMALL_SIZE, SMALL_SIZE);
+        batchE.emplace_back(SMALL_SIZE, SMALL_SIZE);
+        batchF.emplace_back(SMALL_SIZE, SMALL_SIZE);
+    }
+    auto startTime5 = chrono::high_resolution_clock::now();
+    double batchSum = 0;
+    {
+        AsyncMatrixOperations batch(pool);
+        vector<MatrixFuture> futureResults;
+        for (int i = 0; i < BATCH_SIZE; i++) {
+            MatrixFuture futureD = batch.add(smallA, smallB, batchD[i]);
+            MatrixFuture futureE = batch.add(smallB, smallC, batchE[i]);
+            futureResults.push_back(batch.add(batchD[i], batchE[i], batchF[i], {futureD, futureE}));
+        }
+        for (const MatrixFuture& futureResult : futureResults) {
+            batchSum += futureResult.get();
+        }
+    }
+    auto endTime5 = chrono::high_resolution_clock::now();
+    auto batchTime = chrono::duration<double, milli>(endTime5 - startTime5).count();
+
     cout << "Matrix size: " << NUM_ROWS << " x " << NUM_COLS << endl;
     cout << "Threads used: " << numThreads << endl;
+    cout << "Row kernel: " << rowKernels().name << endl;
     cout << "Unthreaded sum = " << unthreadedTotalSum << endl;
     cout << "Threaded total sum = " << threadedTotalSum << endl;
+    cout << "Pairwise sums match: " << (unthreadedPairwiseSum == threadedPairwiseSum ? "yes" : "no") << endl;
     cout << "Unthreaded time: " << time1 << " ms" << endl;
     cout << "Threaded time: " << time2 << " ms" << endl;
-
-} // end main
\ No newline at end of file
+    cout << "Fused A + B + C * 2.0 (" << EXPR_SIZE << " x " << EXPR_SIZE << "): " << time3 << " ms, "
+         << (fusedCorrect ? "correct" : "WRONG") << endl;
+    cout << "A + B^T via transposed view (" << EXPR_SIZE << " x " << EXPR_SIZE << "): " << transposedTime << " ms, "
+         << (transposedCorrect ? "correct" : "WRONG") << endl;
+    cout << "R = R + R^T with R aliased: " << (aliasedCorrect ? "correct" : "WRONG") << endl;
+    cout << "Mapped file addition (" << MAPPED_SIZE << " x " << MAPPED_SIZE << "): " << mappedTime << " ms, sum = "
+         << mappedSum << endl;
+    cout << "Sparse sum nonzeros: " << sparseSum.nonZeros() << ", (A + B) * ones: first = " << product.front()
+         << ", middle = " << product[EXPR_SIZE / 2] << ", last = " << product.back() << endl;
+    cout << "Async batch (" << 3 * BATCH_SIZE << " adds of " << SMALL_SIZE << " x " << SMALL_SIZE << "): "
+         << batchTime << " ms, sum = " << batchSum << endl;
+
+} // end main
@@ -0,0 +1,268 @@
+// Benchmark for the MatrixOperations kernels: sweeps matrix sizes and thread counts,
+// takes the median of several timed repetitions after a warm-up run, and reports
+// bandwidth against a STREAM-style peak measured on the same machine.
+//
+// Usage: ./MatrixBenchmark [--reps N] [--max-size N] [--max-threads N] [--csv FILE] [--json FILE]
+#include "Matrix.h"
+#include "MatrixOperations.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// One row of the report
+struct BenchmarkResult {
+    string kernel;
+    int size;
+    int threads;
+    double medianMs;
+    double minMs;
+    double maxMs;
+    double gbPerSecond;
+    double percentOfPeak;
+};
+
+// Runs operation once to warm up, then returns the time of each of reps runs in ms
+static vector<double> timeRepetitions(int reps, const function<void()>& operation) {
+    operation();
+    vector<double> times;
+    for (int i = 0; i < reps; i++) {
+        auto start = chrono::steady_clock::now();
+        operation();
+        auto end = chrono::steady_clock::now();
+        times.push_back(chrono::duration<double, milli>(end - start).count());
+    }
+    return times;
+}
+
+static double median(vector<double> values) {
+    sort(values.begin(), values.end());
+    size_t middle = values.size() / 2;
+    return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2.0;
+}
+
+// STREAM "Add" (c = a + b) over arrays far larger than cache, in GB/s.
+// Like STREAM this reports the best repetition and counts 24 bytes per element.
+static double measureStreamPeak(ThreadPool& pool, long elements, int reps) {
+    vector<double> a(elements), b(elements), c(elements);
+    const int BLOCK = 1 << 16;
+    int numBlocks = static_cast<int>((elements + BLOCK - 1) / BLOCK);
+
+    auto forEachBlock = [&](const function<void(long, long)>& body) {
+        pool.parallelFor(0, numBlocks - 1, 1, [&](int first, int last) {
+            for (int block = first; block <= last; block++) {
+                long begin = static_cast<long>(block) * BLOCK;
+                body(begin, min(begin + BLOCK, elements));
+            }
+        });
+    };
+
+    // Touch the pages from the threads that will use them
+    forEachBlock([&](long begin, long end) {
+        for (long i = begin; i < end; i++) {
+            a[i] = 1.0;
+            b[i] = 2.0;
+            c[i] = 0.0;
+        }
+    });
+
+    vector<double> times = timeRepetitions(reps, [&]() {
+        forEachBlock([&](long begin, long end) {
+            for (long i = begin; i < end; i++) {
+                c[i] = a[i] + b[i];
+            }
+        });
+    });
+    double bestMs = *min_element(times.begin(), times.end());
+    return 3.0 * sizeof(double) * elements / (bestMs * 1e6);
+}
+
+// Times one kernel that moves bytesMoved bytes per call
+static BenchmarkResult runKernel(const string& kernel, int size, int threads, double bytesMoved,
+                                 double peakGbPerSecond, int reps, const function<void()>& operation) {
+    vector<double> times = timeRepetitions(reps, operation);
+    double medianMs = median(times);
+    double gbPerSecond = bytesMoved / (medianMs * 1e6);
+    return {kernel, size, threads, medianMs,
+            *min_element(times.begin(), times.end()), *max_element(times.begin(), times.end()),
+            gbPerSecond, 100.0 * gbPerSecond / peakGbPerSecond};
+}
+
+// Reports the path and returns false if out could not be opened or written
+static bool checkOutput(ofstream& out, const string& path, bool written) {
+    if (written) {
+        out.close();
+    }
+    if (!out) {
+        cerr << "Cannot " << (written ? "write " : "open ") << path << endl;
+        return false;
+    }
+    return true;
+}
+
+static bool writeCsv(const string& path, const vector<BenchmarkResult>& results, double peak) {
+    ofstream out(path);
+    if (!checkOutput(out, path, false)) {
+        return false;
+    }
+    out << "kernel,size,threads,median_ms,min_ms,max_ms,gb_per_s,percent_of_peak,stream_peak_gb_per_s\n";
+    for (const BenchmarkResult& r : results) {
+        out << r.kernel << ',' << r.size << ',' << r.threads << ',' << r.medianMs << ',' << r.minMs << ','
+            << r.maxMs << ',' << r.gbPerSecond << ',' << r.percentOfPeak << ',' << peak << '\n';
+    }
+    return checkOutput(out, path, true);
+}
+
+static bool writeJson(const string& path, const vector<BenchmarkResult>& results, double peak) {
+    ofstream out(path);
+    if (!checkOutput(out, path, false)) {
+        return false;
+    }
+    out << "{\n  \"stream_peak_gb_per_s\": " << peak << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchmarkResult& r = results[i];
+        out << "    {\"kernel\": \"" << r.kernel << "\", \"size\": " << r.size << ", \"threads\": " << r.threads
+            << ", \"median_ms\": " << r.medianMs << ", \"min_ms\": " << r.minMs << ", \"max_ms\": " << r.maxMs
+            << ", \"gb_per_s\": " << r.gbPerSecond << ", \"percent_of_peak\": " << r.percentOfPeak << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return checkOutput(out, path, true);
+}
+
+static int usage(const char* program) {
+    cerr << "Usage: " << program << " [--reps N] [--max-size N] [--max-threads N] [--csv FILE] [--json FILE]"
+         << endl;
+    return 1;
+}
+
+// Positive integer option value, or false if value is not one
+static bool parseCount(const string& value, int& count) {
+    try {
+        size_t used = 0;
+        count = stoi(value, &used);
+        return used == value.size() && count >= 1;
+    } catch (const exception&) {
+        return false;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int reps = 7;
+    int maxSize = 4096;
+    int maxThreads = max(1, static_cast<int>(thread::hardware_concurrency()));
+    string csvPath;
+    string jsonPath;
+
+    // Read options
+    for (int i = 1; i < argc; i += 2) {
+        string option = argv[i];
+        if (option != "--reps" && option != "--max-size" && option != "--max-threads" && option != "--csv"
+            && option != "--json") {
+            cerr << "Unknown option: " << option << endl;
+            return usage(argv[0]);
+        }
+        if (i + 1 >= argc) {
+            cerr << "Missing value for " << option << endl;
+            return usage(argv[0]);
+        }
+
+        string value = argv[i + 1];
+        if (option == "--csv") {
+            csvPath = value;
+        } else if (option == "--json") {
+            jsonPath = value;
+        } else {
+            int& count = option == "--reps" ? reps : option == "--max-size" ? maxSize : maxThreads;
+            if (!parseCount(value, count)) {
+                cerr << "Expected a positive integer for " << option << ", got: " << value << endl;
+                return usage(argv[0]);
+            }
+        }
+    }
+
+    // Thread counts 1, 2, 4, ... plus the maximum
+    vector<int> threadCounts;
+    for (int threads = 1; threads < maxThreads; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    // Peak bandwidth with all threads, on 3 x 256 MB arrays
+    double peak;
+    {
+        ThreadPool pool(maxThreads);
+        peak = measureStreamPeak(pool, 32L * 1024 * 1024, reps);
+    }
+    cout << "STREAM-style peak (" << maxThreads << " threads): " << peak << " GB/s" << endl;
+
+    vector<BenchmarkResult> results;
+    cout << left << setw(14) << "kernel" << setw(8) << "size" << setw(9) << "threads"
+         << setw(12) << "median ms" << setw(10) << "GB/s" << "% peak" << endl;
+
+    for (int size = 256; size <= maxSize; size *= 2) {
+        Matrix a(size, size), b(size, size), c(size, size), result(size, size);
+        for (int i = 0; i < size; i++) {
+            for (int j = 0; j < size; j++) {
+                a.at(i, j) = i + j;
+                b.at(i, j) = i - j;
+                c.at(i, j) = j;
+            }
+        }
+        double bytes = static_cast<double>(sizeof(double)) * size * size;
+
+        // Reduced-precision copies of the inputs
+        BasicMatrix<float> floatA(a), floatB(b), floatResult(size, size);
+        BasicMatrix<BFloat16> halfA(a), halfB(b), halfResult(size, size);
+
+        for (int threads : threadCounts) {
+            ThreadPool pool(threads);
+            vector<BenchmarkResult> rows;
+            rows.push_back(runKernel("add", size, threads, 3 * bytes, peak, reps, [&]() {
+                MatrixOperations::threadedMatrixAdd(a, b, result, pool);
+            }));
+            rows.push_back(runKernel("add-kahan", size, threads, 3 * bytes, peak, reps, [&]() {
+                MatrixOperations::threadedMatrixAdd(a, b, result, pool, SumMode::KAHAN);
+            }));
+            rows.push_back(runKernel("add-float", size, threads, 3 * bytes / 2, peak, reps, [&]() {
+                MatrixOperations::threadedMatrixAdd(floatA, floatB, floatResult, pool);
+            }));
+            rows.push_back(runKernel("add-bf16", size, threads, 3 * bytes / 4, peak, reps, [&]() {
+                MatrixOperations::threadedMatrixAdd(halfA, halfB, halfResult, pool);
+            }));
+            rows.push_back(runKernel("fused-a+b+2c", size, threads, 4 * bytes, peak, reps, [&]() {
+                result.assign(a + b + c * 2.0, pool);
+            }));
+            rows.push_back(runKernel("add-a+bT", size, threads, 3 * bytes, peak, reps, [&]() {
+                result.assign(a + transpose(b), pool);
+            }));
+            rows.push_back(runKernel("transpose", size, threads, 2 * bytes, peak, reps, [&]() {
+                MatrixOperations::transpose(a, result, pool);
+            }));
+
+            for (const BenchmarkResult& r : rows) {
+                cout << left << setw(14) << r.kernel << setw(8) << r.size << setw(9) << r.threads
+                     << setw(12) << fixed << setprecision(3) << r.medianMs << setw(10) << setprecision(2)
+                     << r.gbPerSecond << setprecision(1) << r.percentOfPeak << endl;
+                cout.unsetf(ios::fixed);
+                results.push_back(r);
+            }
+        }
+    }
+
+    bool saved = true;
+    if (!csvPath.empty()) {
+        saved = writeCsv(csvPath, results, peak) && saved;
+    }
+    if (!jsonPath.empty()) {
+        saved = writeJson(jsonPath, results, peak) && saved;
+    }
+    return saved ? 0 : 1;
+}
@@ -0,0 +1,244 @@
+#include "MatrixOperations.h"
+#include "MappedMatrix.h"
+#include "Matrix.h"
+#include "RowKernels.h"
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+// Results much larger than the last-level cache are written around it with streaming stores
+static bool streamResults(int numRows, int numCols) {
+    return static_cast<long>(sizeof(double)) * numRows * numCols > STREAM_RESULT_BYTES;
+}
+
+// One chunk's partial sum, padded to its own cache line so threads never share a line
+struct alignas(64) PaddedSum {
+    double sum = 0.0;
+    double compensation = 0.0;
+};
+
+double MatrixOperations::matrixAdd(const double leftMatrix[NUM_ROWS][NUM_COLS],
+                                   const double rightMatrix[NUM_ROWS][NUM_COLS],
+                                   double resultMatrix[NUM_ROWS][NUM_COLS],
+                                   int startRow,
+                                   int endRow,
+                                   SumMode mode) {
+    bool streamStores = streamResults(NUM_ROWS, NUM_COLS);
+
+    if (mode == SumMode::PAIRWISE) {
+        std::vector<double> rowSums(NUM_ROWS);
+        addRows(leftMatrix[0], rightMatrix[0], resultMatrix[0], NUM_COLS, startRow, endRow, rowSums.data(), streamStores);
+        return pairwiseSum(rowSums.data(), startRow, endRow);
+    }
+
+    if (mode == SumMode::KAHAN) {
+        KahanSum sum;
+        for (int row = startRow; row <= endRow; row++) {
+            sum.add(addRowKahan(leftMatrix[row], rightMatrix[row], resultMatrix[row], NUM_COLS, streamStores));
+        }
+        return sum.result();
+    }
+
+    // Accumulate in a local so the sum stays in a register
+    double sum = 0.0;
+    for (int row = startRow; row <= endRow; row++) {
+        sum += addRow(leftMatrix[row], rightMatrix[row], resultMatrix[row], NUM_COLS, streamStores);
+    }
+    return sum;
+} // end matrixAdd
+
+double MatrixOperations::threadedMatrixAdd(const double leftMatrix[NUM_ROWS][NUM_COLS],
+                                           const double rightMatrix[NUM_ROWS][NUM_COLS],
+                                           double resultMatrix[NUM_ROWS][NUM_COLS],
+                                           ThreadPool& pool,
+                                           SumMode mode) {
+    return threadedAdd(leftMatrix[0], rightMatrix[0], resultMatrix[0], NUM_ROWS, NUM_COLS, pool, mode);
+}
+
+double MatrixOperations::threadedMatrixAdd(const double leftMatrix[NUM_ROWS][NUM_COLS],
+                                           const double rightMatrix[NUM_ROWS][NUM_COLS],
+                                           double resultMatrix[NUM_ROWS][NUM_COLS],
+                                           int numThreads,
+                                           SumMode mode) {
+    return threadedMatrixAdd(leftMatrix, rightMatrix, resultMatrix, sharedPool(numThreads), mode);
+}
+
+double MatrixOperations::threadedMatrixAdd(const Matrix& left, const Matrix& right, Matrix& result,
+                                           ThreadPool& pool, SumMode mode) {
+    if (left.rows() != right.rows() || left.cols() != right.cols()
+        || left.rows() != result.rows() || left.cols() != result.cols()) {
+        throw std::invalid_argument("Matrix dimensions do not match");
+    }
+    return threadedAdd(left.row(0), right.row(0), result.row(0), left.rows(), left.cols(), pool, mode);
+}
+
+double MatrixOperations::threadedAdd(const double* left, const double* right, double* result,
+                                     int numRows, int numCols, ThreadPool& pool, SumMode mode) {
+    int chunkRows = rowsPerChunk(numCols);
+    int numChunks = (numRows + chunkRows - 1) / chunkRows;
+    bool streamStores = streamResults(numRows, numCols);
+    std::vector<PaddedSum> chunkSums(numChunks);
+    std::vector<double> rowSums(mode == SumMode::PAIRWISE ? numRows : 0);
+
+    pool.parallelFor(0, numRows - 1, chunkRows, [&](int startRow, int endRow) {
+        PaddedSum& chunkSum = chunkSums[startRow / chunkRows];
+        long offset = static_cast<long>(startRow) * numCols;
+        if (mode == SumMode::PAIRWISE) {
+            // Rows are reduced afterwards so the grouping does not depend on the thread count
+            addRows(left, right, result, numCols, startRow, endRow, rowSums.data(), streamStores);
+        } else if (mode == SumMode::KAHAN) {
+            KahanSum sum;
+            for (int row = startRow; row <= endRow; row++, offset += numCols) {
+                sum.add(addRowKahan(left + offset, right + offset, result + offset, numCols, streamStores));
+            }
+            chunkSum.sum = sum.sum;
+            chunkSum.compensation = sum.compensation;
+        } else {
+            // Accumulated in a register, written to the shared slot once
+            double sum = 0.0;
+            for (int row = startRow; row <= endRow; row++, offset += numCols) {
+                sum += addRow(left + offset, right + offset, result + offset, numCols, streamStores);
+            }
+            chunkSum.sum = sum;
+        }
+    });
+
+    // Combine sums in row order
+    if (mode == SumMode::PAIRWISE) {
+        return pairwiseSum(rowSums.data(), 0, numRows - 1);
+    }
+
+    KahanSum total;
+    for (const PaddedSum& chunkSum : chunkSums) {
+        if (mode == SumMode::KAHAN) {
+            total.add(chunkSum.sum);
+            total.add(chunkSum.compensation);
+        } else {
+            total.sum += chunkSum.sum;
+        }
+    }
+    return total.result();
+}
+
+// Bytes of each matrix handled per tile by mappedMatrixAdd
+static const long MAPPED_TILE_BYTES = 64L * 1024 * 1024;
+
+double MatrixOperations::mappedMatrixAdd(const MappedMatrix& left,
+                                         const MappedMatrix& right,
+                                         MappedMatrix& result,
+                                         ThreadPool& pool,
+                                         int tileRows) {
+    if (left.rows() != right.rows() || left.cols() != right.cols()
+        || left.rows() != result.rows() || left.cols() != result.cols()) {
+        throw std::invalid_argument("Matrix dimensions do not match");
+    }
+    if (!result.writable()) {
+        throw std::invalid_argument("Result matrix file is mapped read-only");
+    }
+
+    int numRows = left.rows();
+    int numCols = left.cols();
+    if (tileRows <= 0) {
+        tileRows = static_cast<int>(std::max(1L, MAPPED_TILE_BYTES / (std::max(numCols, 1) * static_cast<long>(sizeof(double)))));
+    }
+    int chunkRows = rowsPerChunk(numCols);
+
+    KahanSum total;
+    left.willNeed(0, tileRows - 1);
+    right.willNeed(0, tileRows - 1);
+
+    for (int firstRow = 0; firstRow < numRows; firstRow += tileRows) {
+        int lastRow = std::min(numRows - firstRow, tileRows) + firstRow - 1;
+
+        // Ask the OS to start reading the next tile while this one is added
+        left.willNeed(lastRow + 1, lastRow + tileRows);
+        right.willNeed(lastRow + 1, lastRow + tileRows);
+
+        std::vector<PaddedSum> chunkSums((lastRow - firstRow) / chunkRows + 1);
+        pool.parallelFor(firstRow, lastRow, chunkRows, [&](int startRow, int endRow) {
+            double sum = 0.0;
+            for (int row = startRow; row <= endRow; row++) {
+                sum += addRow(left.row(row), right.row(row), result.row(row), numCols, true);
+            }
+            chunkSums[(startRow - firstRow) / chunkRows].sum = sum;
+        });
+        for (const PaddedSum& chunkSum : chunkSums) {
+            total.add(chunkSum.sum);
+        }
+
+        // Write the finished tile back and release all three tiles from memory
+        result.flush(firstRow, lastRow);
+        result.doneWith(firstRow, lastRow);
+        left.doneWith(firstRow, lastRow);
+        right.doneWith(firstRow, lastRow);
+    }
+    return total.result();
+}
+
+// The shared pool and the mutex guarding its creation
+int MatrixOperations::rowsPerChunk(int numCols, long elementBytes) {
+    if (numCols <= 0) {
+        return ROWS_PER_CHUNK;
+    }
+    long chunkBytes = static_cast<long>(ROWS_PER_CHUNK) * NUM_COLS * static_cast<long>(sizeof(double));
+    return std::max(1, static_cast<int>(chunkBytes / (numCols * elementBytes)));
+}
+
+static std::mutex sharedPoolMutex;
+static std::unique_ptr<ThreadPool> sharedPoolInstance;
+
+ThreadPool& MatrixOperations::sharedPool(int numThreads, bool pinThreads) {
+    if (numThreads <= 0) {
+        numThreads = 4;
+    }
+
+    std::lock_guard<std::mutex> lock(sharedPoolMutex);
+    if (!sharedPoolInstance || sharedPoolInstance->size() != numThreads || sharedPoolInstance->pinned() != pinThreads) {
+        sharedPoolInstance.reset();
+        sharedPoolInstance = std::make_unique<ThreadPool>(numThreads, pinThreads);
+    }
+    return *sharedPoolInstance;
+}
+
+ThreadPool& MatrixOperations::sharedPool() {
+    std::lock_guard<std::mutex> lock(sharedPoolMutex);
+    if (!sharedPoolInstance) {
+        sharedPoolInstance = std::make_unique<ThreadPool>();
+    }
+    return *sharedPoolInstance;
+}
+
+void MatrixOperations::addRows(const double* left, const double* right, double* result, int numCols,
+                               int startRow, int endRow, double* rowSums, bool streamStores) {
+    long offset = static_cast<long>(startRow) * numCols;
+    for (int row = startRow; row <= endRow; row++, offset += numCols) {
+        rowSums[row] = addRowKahan(left + offset, right + offset, result + offset, numCols, streamStores);
+    }
+}
+
+// Helper for adding a single row with the SIMD kernel chosen for this CPU
+double MatrixOperations::addRow(const double* left, const double* right, double* result, int numCols,
+                                bool streamStores) {
+    return rowKernels().addRow(left, right, result, numCols, streamStores);
+}
+
+// Helper for adding a single row with a compensated sum
+double MatrixOperations::addRowKahan(const double* left, const double* right, double* result, int numCols,
+                                     bool streamStores) {
+    return rowKernels().addRowKahan(left, right, result, numCols, streamStores);
+}
+
+double MatrixOperations::pairwiseSum(const double* values, int first, int last) {
+    // Small ranges are summed directly
+    if (last - first < 8) {
+        double sum = 0.0;
+        for (int i = first; i <= last; i++) {
+            sum += values[i];
+        }
+        return sum;
+    }
+    int middle = first + (last - first) / 2;
+    return pairwiseSum(values, first, middle) + pairwiseSum(values, middle + 1, last);
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "ThreadPool.h"
+
+class MappedMatrix;
+template <typename T>
+class BasicMatrix;
+template <typename T>
+class MatrixView;
+using Matrix = BasicMatrix<double>;
+
+// Matrix dimensions
+const int NUM_ROWS = 9000;
+const int NUM_COLS = 9000;
+
+// Rows handed to a thread at a time: small enough to balance load, large enough to amortise scheduling
+const int ROWS_PER_CHUNK = 16;
+
+// Side of the square tiles used when an expression reads an operand down its columns
+const int TILE_SIZE = 64;
+
+// Largest block the cache-oblivious copy and transpose move without splitting further
+const int COPY_BLOCK_ELEMENTS = 32 * 32;
+
+// Results larger than this are written around the cache with streaming stores
+const long STREAM_RESULT_BYTES = 64L * 1024 * 1024;
+
+// How the sum of all elements of the result matrix is accumulated
+enum class SumMode {
+    FAST,       // plain accumulation per chunk of rows, chunks combined in row order
+    KAHAN,      // compensated summation, error independent of the matrix size
+    PAIRWISE    // per-row sums combined pairwise in row order (same bits for any thread count)
+};
+
+class MatrixOperations {
+    public:
+        // Add rows [startRow, endRow] of two matrices returning the sum of all elements of the result
+        static double matrixAdd(const double leftMatrix[NUM_ROWS][NUM_COLS],
+                                const double rightMatrix[NUM_ROWS][NUM_COLS],
+                                double resultMatrix[NUM_ROWS][NUM_COLS],
+                                int startRow,
+                                int endRow,
+                                SumMode mode = SumMode::FAST);
+
+        // Add two matrices on a thread pool returning the sum of all elements of the result
+        // KAHAN agrees with the unthreaded sum to within about 2 * eps * sum(|value|),
+        // PAIRWISE agrees with the unthreaded PAIRWISE sum bit-for-bit
+        static double threadedMatrixAdd(const double leftMatrix[NUM_ROWS][NUM_COLS],
+                                        const double rightMatrix[NUM_ROWS][NUM_COLS],
+                                        double resultMatrix[NUM_ROWS][NUM_COLS],
+                                        ThreadPool& pool,
+                                        SumMode mode = SumMode::FAST);
+
+        // Same as above using the pool shared by all MatrixOperations calls
+        static double threadedMatrixAdd(const double leftMatrix[NUM_ROWS][NUM_COLS],
+                                        const double rightMatrix[NUM_ROWS][NUM_COLS],
+                                        double resultMatrix[NUM_ROWS][NUM_COLS],
+                                        int numThreads,
+                                        SumMode mode = SumMode::FAST);
+
+        // Same as above for matrices of any size
+        static double threadedMatrixAdd(const Matrix& left,
+                                        const Matrix& right,
+                                        Matrix& result,
+                                        ThreadPool& pool,
+                                        SumMode mode = SumMode::FAST);
+
+        // Reduced-precision add for float or BFloat16 matrices (defined in Matrix.h): elements are
+        // added in Precision<T>::Compute and the sum is kept in Precision<T>::Accumulate
+        template <typename T>
+        static double threadedMatrixAdd(const BasicMatrix<T>& left,
+                                        const BasicMatrix<T>& right,
+                                        BasicMatrix<T>& result,
+                                        ThreadPool& pool);
+
+        // Copy a strided view (transpose, block, slice) into a matrix of the same shape with a
+        // cache-oblivious recursion, for when a layout must be materialised (defined in Matrix.h)
+        template <typename T>
+        static void copy(const MatrixView<T>& source, BasicMatrix<T>& result, ThreadPool& pool);
+
+        // result = source transposed; result must be a different cols x rows matrix (defined in Matrix.h)
+        template <typename T>
+        static void transpose(const BasicMatrix<T>& source, BasicMatrix<T>& result, ThreadPool& pool);
+
+        // Add two memory-mapped matrices one tile of tileRows rows at a time (0 picks about
+        // 64 MB per tile), returning the sum of all elements of the result. The next tile is
+        // read ahead while the current one is added, and finished tiles are written back and
+        // released, so the matrices can be larger than memory. Throws if result is mapped read-only
+        static double mappedMatrixAdd(const MappedMatrix& left,
+                                      const MappedMatrix& right,
+                                      MappedMatrix& result,
+                                      ThreadPool& pool,
+                                      int tileRows = 0);
+
+        // Pool shared by MatrixOperations calls, started on first use and only rebuilt when
+        // numThreads or pinThreads changes (must not be rebuilt while another thread is using it)
+        static ThreadPool& sharedPool(int numThreads, bool pinThreads = false);
+
+        // The shared pool at its current size, started with one thread per core if none exists yet
+        static ThreadPool& sharedPool();
+
+        // Rows per pool task for rows of numCols elements of elementBytes each, chosen so a chunk
+        // holds about as many bytes as ROWS_PER_CHUNK full-size rows. Every row-parallel operation
+        // splits its rows this way, so a given row always falls in the same chunk.
+        static int rowsPerChunk(int numCols, long elementBytes = sizeof(double));
+
+        // Set matrix[row][col] = value(row, col) in the row chunks threadedMatrixAdd uses, each run
+        // by the thread threadedMatrixAdd first deals it to and never stolen. Pages are placed on the
+        // NUMA node of the thread that first writes them, so each matrix is spread over the nodes
+        // of the threads that will later read it (stably so if the pool's workers are pinned)
+        template <typename ValueFunction>
+        static void parallelFill(double matrix[NUM_ROWS][NUM_COLS], ThreadPool& pool, ValueFunction value) {
+            pool.parallelForStatic(0, NUM_ROWS - 1, rowsPerChunk(NUM_COLS), [&](int startRow, int endRow) {
+                for (int row = startRow; row <= endRow; row++) {
+                    for (int col = 0; col < NUM_COLS; col++) {
+                        matrix[row][col] = value(row, col);
+                    }
+                }
+            });
+        }
+
+    private:
+        // Shared body of the threadedMatrixAdd overloads for numRows contiguous rows of numCols
+        static double threadedAdd(const double* left, const double* right, double* result,
+                                  int numRows, int numCols, ThreadPool& pool, SumMode mode);
+
+        // Add rows [startRow, endRow] writing each row's sum into rowSums[row]
+        static void addRows(const double* left, const double* right, double* result, int numCols,
+                            int startRow, int endRow, double* rowSums, bool streamStores);
+
+        // Add a single row returning the sum of the row
+        static double addRow(const double* left, const double* right, double* result, int numCols,
+                             bool streamStores);
+
+        // Add a single row returning a compensated sum of the row
+        static double addRowKahan(const double* left, const double* right, double* result, int numCols,
+                                  bool streamStores);
+
+        // Sum values[first, last] by recursive halving
+        static double pairwiseSum(const double* values, int first, int last);
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// bfloat16: the top 16 bits of an IEEE float (8-bit exponent, 7-bit mantissa).
+// Same range as float at a quarter of the memory traffic of double.
+struct BFloat16 {
+    std::uint16_t bits = 0;
+
+    BFloat16() = default;
+
+    // Round to nearest, ties to even; NaN stays a (quiet) NaN
+    BFloat16(float value) {
+        std::uint32_t word;
+        std::memcpy(&word, &value, sizeof(word));
+        if ((word & 0x7FFFFFFFu) > 0x7F800000u) {
+            bits = static_cast<std::uint16_t>((word >> 16) | 0x0040u);
+        } else {
+            word += 0x7FFFu + ((word >> 16) & 1u);
+            bits = static_cast<std::uint16_t>(word >> 16);
+        }
+    }
+
+    operator float() const {
+        std::uint32_t word = static_cast<std::uint32_t>(bits) << 16;
+        float value;
+        std::memcpy(&value, &word, sizeof(value));
+        return value;
+    }
+};
+
+// Arithmetic types used with each storage type:
+// Compute is what elements are loaded as and added in, Accumulate is what sums are kept in
+template <typename T>
+struct Precision;
+
+template <>
+struct Precision<double> {
+    using Compute = double;
+    using Accumulate = double;
+};
+
+template <>
+struct Precision<float> {
+    using Compute = float;
+    using Accumulate = double;
+};
+
+template <>
+struct Precision<BFloat16> {
+    using Compute = float;
+    using Accumulate = float;
+};
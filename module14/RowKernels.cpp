@@ -0,0 +1,456 @@
+#include "RowKernels.h"
+#include <cstdint>
+
+// Explicit SIMD kernels need GCC/Clang target attributes on x86
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define ROW_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+// Number of leading elements to handle one at a time so result + col is aligned for streaming
+template <typename T>
+static inline int alignedStart(const T* result, int numCols, int alignment, bool streamStores) {
+    if (!streamStores) {
+        return 0;
+    }
+    int col = 0;
+    while (col < numCols && (reinterpret_cast<std::uintptr_t>(result + col) % alignment) != 0) {
+        col++;
+    }
+    return col;
+}
+
+/*
+SCALAR KERNELS
+*/
+static double addRowScalar(const double* left, const double* right, double* result,
+                           int numCols, bool /*streamStores*/) {
+    // Four independent sums so each add does not wait on the previous one
+    double sum0 = 0.0, sum1 = 0.0, sum2 = 0.0, sum3 = 0.0;
+    int col = 0;
+    for (; col + 4 <= numCols; col += 4) {
+        double value0 = left[col] + right[col];
+        double value1 = left[col + 1] + right[col + 1];
+        double value2 = left[col + 2] + right[col + 2];
+        double value3 = left[col + 3] + right[col + 3];
+        result[col] = value0;
+        result[col + 1] = value1;
+        result[col + 2] = value2;
+        result[col + 3] = value3;
+        sum0 += value0;
+        sum1 += value1;
+        sum2 += value2;
+        sum3 += value3;
+    }
+    for (; col < numCols; col++) {
+        double value = left[col] + right[col];
+        result[col] = value;
+        sum0 += value;
+    }
+    return (sum0 + sum1) + (sum2 + sum3);
+}
+
+static double addRowKahanScalar(const double* left, const double* right, double* result,
+                                int numCols, bool /*streamStores*/) {
+    KahanSum sum;
+    for (int col = 0; col < numCols; col++) {
+        double value = left[col] + right[col];
+        result[col] = value;
+        sum.add(value);
+    }
+    return sum.result();
+}
+
+static double addRowFloatScalar(const float* left, const float* right, float* result,
+                                int numCols, bool /*streamStores*/) {
+    return addRowConverted<float, float, double>(left, right, result, numCols);
+}
+
+static float addRowBFloat16Scalar(const BFloat16* left, const BFloat16* right, BFloat16* result,
+                                  int numCols, bool /*streamStores*/) {
+    return addRowConverted<BFloat16, float, float>(left, right, result, numCols);
+}
+
+#ifdef ROW_KERNELS_X86
+/*
+SSE2 KERNELS
+*/
+__attribute__((target("sse2")))
+static double addRowSse2(const double* left, const double* right, double* result,
+                         int numCols, bool streamStores) {
+    double sum = 0.0;
+    int col = alignedStart(result, numCols, 16, streamStores);
+    for (int i = 0; i < col; i++) {
+        result[i] = left[i] + right[i];
+        sum += result[i];
+    }
+
+    __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+    __m128d acc2 = _mm_setzero_pd(), acc3 = _mm_setzero_pd();
+    for (; col + 8 <= numCols; col += 8) {
+        __m128d v0 = _mm_add_pd(_mm_loadu_pd(left + col), _mm_loadu_pd(right + col));
+        __m128d v1 = _mm_add_pd(_mm_loadu_pd(left + col + 2), _mm_loadu_pd(right + col + 2));
+        __m128d v2 = _mm_add_pd(_mm_loadu_pd(left + col + 4), _mm_loadu_pd(right + col + 4));
+        __m128d v3 = _mm_add_pd(_mm_loadu_pd(left + col + 6), _mm_loadu_pd(right + col + 6));
+        if (streamStores) {
+            _mm_stream_pd(result + col, v0);
+            _mm_stream_pd(result + col + 2, v1);
+            _mm_stream_pd(result + col + 4, v2);
+            _mm_stream_pd(result + col + 6, v3);
+        } else {
+            _mm_storeu_pd(result + col, v0);
+            _mm_storeu_pd(result + col + 2, v1);
+            _mm_storeu_pd(result + col + 4, v2);
+            _mm_storeu_pd(result + col + 6, v3);
+        }
+        acc0 = _mm_add_pd(acc0, v0);
+        acc1 = _mm_add_pd(acc1, v1);
+        acc2 = _mm_add_pd(acc2, v2);
+        acc3 = _mm_add_pd(acc3, v3);
+    }
+    if (streamStores) {
+        _mm_sfence();
+    }
+
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(_mm_add_pd(acc0, acc1), _mm_add_pd(acc2, acc3)));
+    sum += lanes[0] + lanes[1];
+
+    for (; col < numCols; col++) {
+        result[col] = left[col] + right[col];
+        sum += result[col];
+    }
+    return sum;
+}
+
+/*
+AVX2 KERNELS
+*/
+__attribute__((target("avx2")))
+static double addRowAvx2(const double* left, const double* right, double* result,
+                         int numCols, bool streamStores) {
+    double sum = 0.0;
+    int col = alignedStart(result, numCols, 32, streamStores);
+    for (int i = 0; i < col; i++) {
+        result[i] = left[i] + right[i];
+        sum += result[i];
+    }
+
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    __m256d acc2 = _mm256_setzero_pd(), acc3 = _mm256_setzero_pd();
+    for (; col + 16 <= numCols; col += 16) {
+        __m256d v0 = _mm256_add_pd(_mm256_loadu_pd(left + col), _mm256_loadu_pd(right + col));
+        __m256d v1 = _mm256_add_pd(_mm256_loadu_pd(left + col + 4), _mm256_loadu_pd(right + col + 4));
+        __m256d v2 = _mm256_add_pd(_mm256_loadu_pd(left + col + 8), _mm256_loadu_pd(right + col + 8));
+        __m256d v3 = _mm256_add_pd(_mm256_loadu_pd(left + col + 12), _mm256_loadu_pd(right + col + 12));
+        if (streamStores) {
+            _mm256_stream_pd(result + col, v0);
+            _mm256_stream_pd(result + col + 4, v1);
+            _mm256_stream_pd(result + col + 8, v2);
+            _mm256_stream_pd(result + col + 12, v3);
+        } else {
+            _mm256_storeu_pd(result + col, v0);
+            _mm256_storeu_pd(result + col + 4, v1);
+            _mm256_storeu_pd(result + col + 8, v2);
+            _mm256_storeu_pd(result + col + 12, v3);
+        }
+        acc0 = _mm256_add_pd(acc0, v0);
+        acc1 = _mm256_add_pd(acc1, v1);
+        acc2 = _mm256_add_pd(acc2, v2);
+        acc3 = _mm256_add_pd(acc3, v3);
+    }
+    if (streamStores) {
+        _mm_sfence();
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(_mm256_add_pd(acc0, acc1), _mm256_add_pd(acc2, acc3)));
+    sum += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+
+    for (; col < numCols; col++) {
+        result[col] = left[col] + right[col];
+        sum += result[col];
+    }
+    return sum;
+}
+
+__attribute__((target("avx2")))
+static double addRowKahanAvx2(const double* left, const double* right, double* result,
+                              int numCols, bool streamStores) {
+    KahanSum total;
+    int col = alignedStart(result, numCols, 32, streamStores);
+    for (int i = 0; i < col; i++) {
+        result[i] = left[i] + right[i];
+        total.add(result[i]);
+    }
+
+    // Classic Kahan update per lane: y = v - c, t = s + y, c = (t - s) - y, s = t
+    __m256d sum0 = _mm256_setzero_pd(), comp0 = _mm256_setzero_pd();
+    __m256d sum1 = _mm256_setzero_pd(), comp1 = _mm256_setzero_pd();
+    for (; col + 8 <= numCols; col += 8) {
+        __m256d v0 = _mm256_add_pd(_mm256_loadu_pd(left + col), _mm256_loadu_pd(right + col));
+        __m256d v1 = _mm256_add_pd(_mm256_loadu_pd(left + col + 4), _mm256_loadu_pd(right + col + 4));
+        if (streamStores) {
+            _mm256_stream_pd(result + col, v0);
+            _mm256_stream_pd(result + col + 4, v1);
+        } else {
+            _mm256_storeu_pd(result + col, v0);
+            _mm256_storeu_pd(result + col + 4, v1);
+        }
+        __m256d y0 = _mm256_sub_pd(v0, comp0);
+        __m256d y1 = _mm256_sub_pd(v1, comp1);
+        __m256d t0 = _mm256_add_pd(sum0, y0);
+        __m256d t1 = _mm256_add_pd(sum1, y1);
+        comp0 = _mm256_sub_pd(_mm256_sub_pd(t0, sum0), y0);
+        comp1 = _mm256_sub_pd(_mm256_sub_pd(t1, sum1), y1);
+        sum0 = t0;
+        sum1 = t1;
+    }
+    if (streamStores) {
+        _mm_sfence();
+    }
+
+    double sums[8], comps[8];
+    _mm256_storeu_pd(sums, sum0);
+    _mm256_storeu_pd(sums + 4, sum1);
+    _mm256_storeu_pd(comps, comp0);
+    _mm256_storeu_pd(comps + 4, comp1);
+    for (int lane = 0; lane < 8; lane++) {
+        total.add(sums[lane]);
+        total.add(-comps[lane]);
+    }
+
+    for (; col < numCols; col++) {
+        result[col] = left[col] + right[col];
+        total.add(result[col]);
+    }
+    return total.result();
+}
+
+/*
+AVX-512 KERNELS
+*/
+__attribute__((target("avx512f")))
+static double addRowAvx512(const double* left, const double* right, double* result,
+                           int numCols, bool streamStores) {
+    double sum = 0.0;
+    int col = alignedStart(result, numCols, 64, streamStores);
+    for (int i = 0; i < col; i++) {
+        result[i] = left[i] + right[i];
+        sum += result[i];
+    }
+
+    __m512d acc0 = _mm512_setzero_pd(), acc1 = _mm512_setzero_pd();
+    __m512d acc2 = _mm512_setzero_pd(), acc3 = _mm512_setzero_pd();
+    for (; col + 32 <= numCols; col += 32) {
+        __m512d v0 = _mm512_add_pd(_mm512_loadu_pd(left + col), _mm512_loadu_pd(right + col));
+        __m512d v1 = _mm512_add_pd(_mm512_loadu_pd(left + col + 8), _mm512_loadu_pd(right + col + 8));
+        __m512d v2 = _mm512_add_pd(_mm512_loadu_pd(left + col + 16), _mm512_loadu_pd(right + col + 16));
+        __m512d v3 = _mm512_add_pd(_mm512_loadu_pd(left + col + 24), _mm512_loadu_pd(right + col + 24));
+        if (streamStores) {
+            _mm512_stream_pd(result + col, v0);
+            _mm512_stream_pd(result + col + 8, v1);
+            _mm512_stream_pd(result + col + 16, v2);
+            _mm512_stream_pd(result + col + 24, v3);
+        } else {
+            _mm512_storeu_pd(result + col, v0);
+            _mm512_storeu_pd(result + col + 8, v1);
+            _mm512_storeu_pd(result + col + 16, v2);
+            _mm512_storeu_pd(result + col + 24, v3);
+        }
+        acc0 = _mm512_add_pd(acc0, v0);
+        acc1 = _mm512_add_pd(acc1, v1);
+        acc2 = _mm512_add_pd(acc2, v2);
+        acc3 = _mm512_add_pd(acc3, v3);
+    }
+    if (streamStores) {
+        _mm_sfence();
+    }
+
+    double lanes[8];
+    _mm512_storeu_pd(lanes, _mm512_add_pd(_mm512_add_pd(acc0, acc1), _mm512_add_pd(acc2, acc3)));
+    sum += ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+
+    for (; col < numCols; col++) {
+        result[col] = left[col] + right[col];
+        sum += result[col];
+    }
+    return sum;
+}
+
+__attribute__((target("avx512f")))
+static double addRowKahanAvx512(const double* left, const double* right, double* result,
+                                int numCols, bool streamStores) {
+    KahanSum total;
+    int col = alignedStart(result, numCols, 64, streamStores);
+    for (int i = 0; i < col; i++) {
+        result[i] = left[i] + right[i];
+        total.add(result[i]);
+    }
+
+    // Classic Kahan update per lane: y = v - c, t = s + y, c = (t - s) - y, s = t
+    __m512d sum0 = _mm512_setzero_pd(), comp0 = _mm512_setzero_pd();
+    __m512d sum1 = _mm512_setzero_pd(), comp1 = _mm512_setzero_pd();
+    for (; col + 16 <= numCols; col += 16) {
+        __m512d v0 = _mm512_add_pd(_mm512_loadu_pd(left + col), _mm512_loadu_pd(right + col));
+        __m512d v1 = _mm512_add_pd(_mm512_loadu_pd(left + col + 8), _mm512_loadu_pd(right + col + 8));
+        if (streamStores) {
+            _mm512_stream_pd(result + col, v0);
+            _mm512_stream_pd(result + col + 8, v1);
+        } else {
+            _mm512_storeu_pd(result + col, v0);
+            _mm512_storeu_pd(result + col + 8, v1);
+        }
+        __m512d y0 = _mm512_sub_pd(v0, comp0);
+        __m512d y1 = _mm512_sub_pd(v1, comp1);
+        __m512d t0 = _mm512_add_pd(sum0, y0);
+        __m512d t1 = _mm512_add_pd(sum1, y1);
+        comp0 = _mm512_sub_pd(_mm512_sub_pd(t0, sum0), y0);
+        comp1 = _mm512_sub_pd(_mm512_sub_pd(t1, sum1), y1);
+        sum0 = t0;
+        sum1 = t1;
+    }
+    if (streamStores) {
+        _mm_sfence();
+    }
+
+    double sums[16], comps[16];
+    _mm512_storeu_pd(sums, sum0);
+    _mm512_storeu_pd(sums + 8, sum1);
+    _mm512_storeu_pd(comps, comp0);
+    _mm512_storeu_pd(comps + 8, comp1);
+    for (int lane = 0; lane < 16; lane++) {
+        total.add(sums[lane]);
+        total.add(-comps[lane]);
+    }
+
+    for (; col < numCols; col++) {
+        result[col] = left[col] + right[col];
+        total.add(result[col]);
+    }
+    return total.result();
+}
+
+/*
+AVX2 REDUCED-PRECISION KERNELS
+*/
+__attribute__((target("avx2")))
+static double addRowFloatAvx2(const float* left, const float* right, float* result,
+                              int numCols, bool streamStores) {
+    double sum = 0.0;
+    int col = alignedStart(result, numCols, 32, streamStores);
+    for (int i = 0; i < col; i++) {
+        result[i] = left[i] + right[i];
+        sum += result[i];
+    }
+
+    // Floats are added in float, then widened to double for the running sums
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    __m256d acc2 = _mm256_setzero_pd(), acc3 = _mm256_setzero_pd();
+    for (; col + 16 <= numCols; col += 16) {
+        __m256 v0 = _mm256_add_ps(_mm256_loadu_ps(left + col), _mm256_loadu_ps(right + col));
+        __m256 v1 = _mm256_add_ps(_mm256_loadu_ps(left + col + 8), _mm256_loadu_ps(right + col + 8));
+        if (streamStores) {
+            _mm256_stream_ps(result + col, v0);
+            _mm256_stream_ps(result + col + 8, v1);
+        } else {
+            _mm256_storeu_ps(result + col, v0);
+            _mm256_storeu_ps(result + col + 8, v1);
+        }
+        acc0 = _mm256_add_pd(acc0, _mm256_cvtps_pd(_mm256_castps256_ps128(v0)));
+        acc1 = _mm256_add_pd(acc1, _mm256_cvtps_pd(_mm256_extractf128_ps(v0, 1)));
+        acc2 = _mm256_add_pd(acc2, _mm256_cvtps_pd(_mm256_castps256_ps128(v1)));
+        acc3 = _mm256_add_pd(acc3, _mm256_cvtps_pd(_mm256_extractf128_ps(v1, 1)));
+    }
+    if (streamStores) {
+        _mm_sfence();
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(_mm256_add_pd(acc0, acc1), _mm256_add_pd(acc2, acc3)));
+    sum += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+
+    for (; col < numCols; col++) {
+        result[col] = left[col] + right[col];
+        sum += result[col];
+    }
+    return sum;
+}
+
+// Widens 8 bfloat16 values to floats
+__attribute__((target("avx2")))
+static inline __m256 loadBFloat16x8(const BFloat16* values) {
+    __m128i bits = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values));
+    return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(bits), 16));
+}
+
+// Rounds 8 floats to bfloat16 (nearest, ties to even, NaN kept quiet), returning the 32-bit patterns
+__attribute__((target("avx2")))
+static inline __m256i roundToBFloat16x8(__m256 values) {
+    __m256i word = _mm256_castps_si256(values);
+    __m256i lsb = _mm256_and_si256(_mm256_srli_epi32(word, 16), _mm256_set1_epi32(1));
+    __m256i rounded = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(word, _mm256_set1_epi32(0x7FFF)), lsb), 16);
+    __m256i quietNaN = _mm256_or_si256(_mm256_srli_epi32(word, 16), _mm256_set1_epi32(0x0040));
+    __m256 isNaN = _mm256_cmp_ps(values, values, _CMP_UNORD_Q);
+    return _mm256_blendv_epi8(rounded, quietNaN, _mm256_castps_si256(isNaN));
+}
+
+__attribute__((target("avx2")))
+static float addRowBFloat16Avx2(const BFloat16* left, const BFloat16* right, BFloat16* result,
+                                int numCols, bool streamStores) {
+    int col = alignedStart(result, numCols, 32, streamStores);
+    float sum = addRowConverted<BFloat16, float, float>(left, right, result, col);
+
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    for (; col + 16 <= numCols; col += 16) {
+        __m256i bits0 = roundToBFloat16x8(_mm256_add_ps(loadBFloat16x8(left + col), loadBFloat16x8(right + col)));
+        __m256i bits1 = roundToBFloat16x8(_mm256_add_ps(loadBFloat16x8(left + col + 8), loadBFloat16x8(right + col + 8)));
+
+        // Pack the 16 low halves in order: packus works per 128-bit lane, then fix the qword order
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(bits0, bits1), 0xD8);
+        if (streamStores) {
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(result + col), packed);
+        } else {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(result + col), packed);
+        }
+
+        // Sum the stored (rounded) values
+        acc0 = _mm256_add_ps(acc0, _mm256_castsi256_ps(_mm256_slli_epi32(bits0, 16)));
+        acc1 = _mm256_add_ps(acc1, _mm256_castsi256_ps(_mm256_slli_epi32(bits1, 16)));
+    }
+
+    if (streamStores) {
+        _mm_sfence();
+    }
+
+    float lanes[8];
+    _mm256_storeu_ps(lanes, _mm256_add_ps(acc0, acc1));
+    sum += ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+    if (col < numCols) {
+        sum += addRowConverted<BFloat16, float, float>(left + col, right + col, result + col, numCols - col);
+    }
+    return sum;
+}
+#endif // ROW_KERNELS_X86
+
+// Picks the kernels for the running CPU
+static RowKernels selectRowKernels() {
+#ifdef ROW_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return {"AVX-512", addRowAvx512, addRowKahanAvx512, addRowFloatAvx2, addRowBFloat16Avx2};
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return {"AVX2", addRowAvx2, addRowKahanAvx2, addRowFloatAvx2, addRowBFloat16Avx2};
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return {"SSE2", addRowSse2, addRowKahanScalar, addRowFloatScalar, addRowBFloat16Scalar};
+    }
+#endif
+    return {"scalar", addRowScalar, addRowKahanScalar, addRowFloatScalar, addRowBFloat16Scalar};
+}
+
+const RowKernels& rowKernels() {
+    static const RowKernels kernels = selectRowKernels();
+    return kernels;
+}
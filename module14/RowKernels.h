@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Precision.h"
+
+// Neumaier's variant of Kahan summation: keeps the low-order bits lost by each add
+struct KahanSum {
+    double sum = 0.0;
+    double compensation = 0.0;
+
+    void add(double value) {
+        double total = sum + value;
+        if ((sum >= 0 ? sum : -sum) >= (value >= 0 ? value : -value)) {
+            compensation += (sum - total) + value;
+        } else {
+            compensation += (value - total) + sum;
+        }
+        sum = total;
+    }
+
+    double result() const {
+        return sum + compensation;
+    }
+};
+
+// Signature shared by every row kernel: result = left + right, returning the sum of result
+// streamStores writes result with non-temporal stores that bypass the cache
+using AddRowKernel = double (*)(const double* left, const double* right, double* result,
+                                int numCols, bool streamStores);
+
+// Reduced-precision row kernels: float storage summed in double, bfloat16 storage summed in float
+using AddRowFloatKernel = double (*)(const float* left, const float* right, float* result,
+                                     int numCols, bool streamStores);
+using AddRowBFloat16Kernel = float (*)(const BFloat16* left, const BFloat16* right, BFloat16* result,
+                                       int numCols, bool streamStores);
+
+// Set of row kernels built for one instruction set
+struct RowKernels {
+    const char* name;
+    AddRowKernel addRow;        // plain sum, several accumulators to break the dependency chain
+    AddRowKernel addRowKahan;   // compensated sum, one Kahan accumulator per vector lane
+    AddRowFloatKernel addRowFloat;
+    AddRowBFloat16Kernel addRowBFloat16;
+};
+
+// Returns the widest kernels this CPU supports (AVX-512, AVX2, SSE2 or scalar),
+// chosen once on first use
+const RowKernels& rowKernels();
+
+// Portable row kernel for any storage type (used for float and BFloat16 matrices): elements are
+// loaded and added as Compute, stored back as T, and the stored values are summed in Accumulate.
+// Four accumulators break the dependency chain so the compiler can vectorize the loop.
+template <typename T, typename Compute, typename Accumulate>
+Accumulate addRowConverted(const T* left, const T* right, T* result, int numCols) {
+    Accumulate sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+    int col = 0;
+    for (; col + 4 <= numCols; col += 4) {
+        T value0 = static_cast<T>(static_cast<Compute>(left[col]) + static_cast<Compute>(right[col]));
+        T value1 = static_cast<T>(static_cast<Compute>(left[col + 1]) + static_cast<Compute>(right[col + 1]));
+        T value2 = static_cast<T>(static_cast<Compute>(left[col + 2]) + static_cast<Compute>(right[col + 2]));
+        T value3 = static_cast<T>(static_cast<Compute>(left[col + 3]) + static_cast<Compute>(right[col + 3]));
+        result[col] = value0;
+        result[col + 1] = value1;
+        result[col + 2] = value2;
+        result[col + 3] = value3;
+        sum0 += static_cast<Compute>(value0);
+        sum1 += static_cast<Compute>(value1);
+        sum2 += static_cast<Compute>(value2);
+        sum3 += static_cast<Compute>(value3);
+    }
+    for (; col < numCols; col++) {
+        T value = static_cast<T>(static_cast<Compute>(left[col]) + static_cast<Compute>(right[col]));
+        result[col] = value;
+        sum0 += static_cast<Compute>(value);
+    }
+    return (sum0 + sum1) + (sum2 + sum3);
+}
+
+// Row add for a reduced-precision storage type, using the SIMD kernel for it where there is one
+inline double addRowPrecision(const float* left, const float* right, float* result, int numCols,
+                              bool streamStores) {
+    return rowKernels().addRowFloat(left, right, result, numCols, streamStores);
+}
+
+inline float addRowPrecision(const BFloat16* left, const BFloat16* right, BFloat16* result, int numCols,
+                             bool streamStores) {
+    return rowKernels().addRowBFloat16(left, right, result, numCols, streamStores);
+}
@@ -0,0 +1,245 @@
+#include "SparseMatrix.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
+/*
+COO FUNCTIONS
+*/
+CooMatrix::CooMatrix(int rows, int cols) : numRows(rows), numCols(cols) {
+    if (rows < 0 || cols < 0) {
+        throw std::invalid_argument("Matrix dimensions must not be negative");
+    }
+}
+
+CooMatrix CooMatrix::fromDense(const Matrix& dense, double tolerance) {
+    CooMatrix coo(dense.rows(), dense.cols());
+    for (int row = 0; row < dense.rows(); row++) {
+        const double* values = dense.row(row);
+        for (int col = 0; col < dense.cols(); col++) {
+            if (std::fabs(values[col]) > tolerance) {
+                coo.add(row, col, values[col]);
+            }
+        }
+    }
+    return coo;
+}
+
+void CooMatrix::add(int row, int col, double value) {
+    if (row < 0 || row >= numRows || col < 0 || col >= numCols) {
+        throw std::out_of_range("Sparse entry outside the matrix");
+    }
+    rowIndex.push_back(row);
+    colIndex.push_back(col);
+    values.push_back(value);
+}
+
+/*
+CSR FUNCTIONS
+*/
+CsrMatrix::CsrMatrix(int rows, int cols) : numRows(rows), numCols(cols), rowStart(rows + 1, 0) {
+    if (rows < 0 || cols < 0) {
+        throw std::invalid_argument("Matrix dimensions must not be negative");
+    }
+}
+
+CsrMatrix CsrMatrix::fromDense(const Matrix& dense, ThreadPool& pool, double tolerance) {
+    CsrMatrix csr(dense.rows(), dense.cols());
+    int numCols = dense.cols();
+    int taskRows = rowsPerTask(dense.rows(), pool);
+
+    // Pass 1: nonzeros per row, stored one slot ahead so the prefix sum gives row starts
+    pool.parallelFor(0, dense.rows() - 1, taskRows, [&](int startRow, int endRow) {
+        for (int row = startRow; row <= endRow; row++) {
+            const double* values = dense.row(row);
+            long count = 0;
+            for (int col = 0; col < numCols; col++) {
+                count += std::fabs(values[col]) > tolerance;
+            }
+            csr.rowStart[row + 1] = count;
+        }
+    });
+    std::partial_sum(csr.rowStart.begin(), csr.rowStart.end(), csr.rowStart.begin());
+    csr.colIndex.resize(csr.rowStart.back());
+    csr.values.resize(csr.rowStart.back());
+
+    // Pass 2: every row writes its own slice
+    pool.parallelFor(0, dense.rows() - 1, taskRows, [&](int startRow, int endRow) {
+        for (int row = startRow; row <= endRow; row++) {
+            const double* values = dense.row(row);
+            long next = csr.rowStart[row];
+            for (int col = 0; col < numCols; col++) {
+                if (std::fabs(values[col]) > tolerance) {
+                    csr.colIndex[next] = col;
+                    csr.values[next] = values[col];
+                    next++;
+                }
+            }
+        }
+    });
+    return csr;
+}
+
+CsrMatrix CsrMatrix::fromCoo(const CooMatrix& coo) {
+    CsrMatrix csr(coo.rows(), coo.cols());
+
+    // Sort entries by (row, col) so duplicates end up next to each other
+    std::vector<long> order(coo.values.size());
+    std::iota(order.begin(), order.end(), 0L);
+    std::sort(order.begin(), order.end(), [&coo](long a, long b) {
+        if (coo.rowIndex[a] != coo.rowIndex[b]) {
+            return coo.rowIndex[a] < coo.rowIndex[b];
+        }
+        return coo.colIndex[a] < coo.colIndex[b];
+    });
+
+    int lastRow = -1;
+    int lastCol = -1;
+    for (long i : order) {
+        int row = coo.rowIndex[i];
+        int col = coo.colIndex[i];
+        if (row == lastRow && col == lastCol) {
+            csr.values.back() += coo.values[i];
+            continue;
+        }
+        csr.colIndex.push_back(col);
+        csr.values.push_back(coo.values[i]);
+        csr.rowStart[row + 1]++;
+        lastRow = row;
+        lastCol = col;
+    }
+    std::partial_sum(csr.rowStart.begin(), csr.rowStart.end(), csr.rowStart.begin());
+    return csr;
+}
+
+Matrix CsrMatrix::toDense() const {
+    Matrix dense(numRows, numCols);
+    for (int row = 0; row < numRows; row++) {
+        double* out = dense.row(row);
+        for (long i = rowStart[row]; i < rowStart[row + 1]; i++) {
+            out[colIndex[i]] = values[i];
+        }
+    }
+    return dense;
+}
+
+CsrMatrix CsrMatrix::add(const CsrMatrix& left, const CsrMatrix& right, ThreadPool& pool) {
+    if (left.numRows != right.numRows || left.numCols != right.numCols) {
+        throw std::invalid_argument("Matrix dimensions do not match");
+    }
+
+    CsrMatrix sum(left.numRows, left.numCols);
+    int taskRows = rowsPerTask(left.numRows, pool);
+
+    // Merges row `row` of both operands, calling emit(col, value) for each nonzero of the sum
+    auto mergeRow = [&left, &right](int row, auto emit) {
+        long a = left.rowStart[row], aEnd = left.rowStart[row + 1];
+        long b = right.rowStart[row], bEnd = right.rowStart[row + 1];
+        while (a < aEnd || b < bEnd) {
+            int col;
+            double value;
+            if (b == bEnd || (a < aEnd && left.colIndex[a] < right.colIndex[b])) {
+                col = left.colIndex[a];
+                value = left.values[a++];
+            } else if (a == aEnd || right.colIndex[b] < left.colIndex[a]) {
+                col = right.colIndex[b];
+                value = right.values[b++];
+            } else {
+                col = left.colIndex[a];
+                value = left.values[a++] + right.values[b++];
+            }
+            if (value != 0.0) {
+                emit(col, value);
+            }
+        }
+    };
+
+    // Pass 1: size of each merged row
+    pool.parallelFor(0, left.numRows - 1, taskRows, [&](int startRow, int endRow) {
+        for (int row = startRow; row <= endRow; row++) {
+            long count = 0;
+            mergeRow(row, [&count](int, double) { count++; });
+            sum.rowStart[row + 1] = count;
+        }
+    });
+    std::partial_sum(sum.rowStart.begin(), sum.rowStart.end(), sum.rowStart.begin());
+    sum.colIndex.resize(sum.rowStart.back());
+    sum.values.resize(sum.rowStart.back());
+
+    // Pass 2: write the merged rows
+    pool.parallelFor(0, left.numRows - 1, taskRows, [&](int startRow, int endRow) {
+        for (int row = startRow; row <= endRow; row++) {
+            long next = sum.rowStart[row];
+            mergeRow(row, [&sum, &next](int col, double value) {
+                sum.colIndex[next] = col;
+                sum.values[next] = value;
+                next++;
+            });
+        }
+    });
+    return sum;
+}
+
+void CsrMatrix::multiply(const double* x, double* y, ThreadPool& pool) const {
+    std::fill(y, y + numRows, 0.0);
+    long totalNonZeros = nonZeros();
+    if (totalNonZeros == 0) {
+        return;
+    }
+
+    // Each part owns an equal slice of the nonzeros. Rows wholly inside a part are written
+    // directly; a row cut by a part boundary is summed piecewise and combined afterwards.
+    int numParts = static_cast<int>(std::min<long>(totalNonZeros, pool.size() * 4L));
+    std::vector<int> firstRows(numParts, -1), lastRows(numParts, -1);
+    std::vector<double> firstSums(numParts, 0.0), lastSums(numParts, 0.0);
+
+    pool.parallelFor(0, numParts - 1, 1, [&](int part, int) {
+        long begin = totalNonZeros * part / numParts;
+        long end = totalNonZeros * (part + 1) / numParts;
+
+        // Row holding nonzero `begin` (skipping any empty rows before it)
+        int row = static_cast<int>(std::upper_bound(rowStart.begin(), rowStart.end(), begin) - rowStart.begin()) - 1;
+        for (; row < numRows && rowStart[row] < end; row++) {
+            long lo = std::max(rowStart[row], begin);
+            long hi = std::min(rowStart[row + 1], end);
+            double sum = 0.0;
+            for (long i = lo; i < hi; i++) {
+                sum += values[i] * x[colIndex[i]];
+            }
+
+            if (rowStart[row] >= begin && rowStart[row + 1] <= end) {
+                y[row] = sum;
+            } else if (firstRows[part] < 0) {
+                firstRows[part] = row;
+                firstSums[part] = sum;
+            } else {
+                lastRows[part] = row;
+                lastSums[part] = sum;
+            }
+        }
+    });
+
+    // Add the pieces of rows that were split between parts
+    for (int part = 0; part < numParts; part++) {
+        if (firstRows[part] >= 0) {
+            y[firstRows[part]] += firstSums[part];
+        }
+        if (lastRows[part] >= 0) {
+            y[lastRows[part]] += lastSums[part];
+        }
+    }
+}
+
+std::vector<double> CsrMatrix::multiply(const std::vector<double>& x, ThreadPool& pool) const {
+    if (static_cast<int>(x.size()) != numCols) {
+        throw std::invalid_argument("Vector length does not match matrix columns");
+    }
+    std::vector<double> y(numRows);
+    multiply(x.data(), y.data(), pool);
+    return y;
+}
+
+int CsrMatrix::rowsPerTask(int rows, const ThreadPool& pool) {
+    return std::max(1, rows / (pool.size() * 8));
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Matrix.h"
+#include "ThreadPool.h"
+#include <vector>
+
+// Coordinate (COO) sparse matrix: one (row, col, value) triple per nonzero, in any order.
+// Convenient for building a matrix; convert to CsrMatrix for arithmetic.
+class CooMatrix {
+    public:
+        CooMatrix(int rows, int cols);
+
+        // Nonzeros of a dense matrix (entries with |value| <= tolerance are dropped)
+        static CooMatrix fromDense(const Matrix& dense, double tolerance = 0.0);
+
+        // Append an entry; duplicates of the same position are summed on conversion to CSR
+        void add(int row, int col, double value);
+
+        int rows() const { return numRows; }
+        int cols() const { return numCols; }
+        long nonZeros() const { return static_cast<long>(values.size()); }
+
+    private:
+        friend class CsrMatrix;
+        int numRows;
+        int numCols;
+        std::vector<int> rowIndex;
+        std::vector<int> colIndex;
+        std::vector<double> values;
+};
+
+// Compressed sparse row (CSR) matrix: the nonzeros of row r are
+// colIndex/values[rowStart[r] .. rowStart[r + 1]), sorted by column
+class CsrMatrix {
+    public:
+        CsrMatrix(int rows, int cols);
+
+        // Build from dense rows in parallel: count each row's nonzeros, then fill
+        static CsrMatrix fromDense(const Matrix& dense, ThreadPool& pool, double tolerance = 0.0);
+
+        static CsrMatrix fromCoo(const CooMatrix& coo);
+
+        Matrix toDense() const;
+
+        // left + right, merging each row's sorted columns in parallel (exact zeros are dropped)
+        static CsrMatrix add(const CsrMatrix& left, const CsrMatrix& right, ThreadPool& pool);
+
+        // y = A * x, split into tasks with equal numbers of nonzeros rather than equal numbers
+        // of rows, so a few dense rows cannot leave the other threads idle
+        void multiply(const double* x, double* y, ThreadPool& pool) const;
+        std::vector<double> multiply(const std::vector<double>& x, ThreadPool& pool) const;
+
+        int rows() const { return numRows; }
+        int cols() const { return numCols; }
+        long nonZeros() const { return static_cast<long>(values.size()); }
+
+    private:
+        // Rows per task for the row-parallel passes
+        static int rowsPerTask(int rows, const ThreadPool& pool);
+
+        int numRows;
+        int numCols;
+        std::vector<long> rowStart;
+        std::vector<int> colIndex;
+        std::vector<double> values;
+};
@@ -0,0 +1,258 @@
+#include "ThreadPool.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Completion state for one parallelFor call, shared with its tasks so it outlives the last one
+struct TaskGroup {
+    std::atomic<int> remaining{0};
+    std::mutex mutex;
+    std::condition_variable done;
+};
+
+// Pins the calling thread to the index-th CPU in the process's allowed set
+static void pinToCpu(int index) {
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0) {
+        return;
+    }
+
+    int target = index % CPU_COUNT(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && target-- == 0) {
+            cpu_set_t single;
+            CPU_ZERO(&single);
+            CPU_SET(cpu, &single);
+            pthread_setaffinity_np(pthread_self(), sizeof(single), &single);
+            return;
+        }
+    }
+#else
+    (void)index;
+#endif
+}
+
+ThreadPool::ThreadPool(int numThreads, bool pinThreads) : pinThreads(pinThreads) {
+    if (numThreads <= 0) {
+        numThreads = static_cast<int>(std::thread::hardware_concurrency());
+    }
+    if (numThreads <= 0) {
+        numThreads = 1;
+    }
+
+    // The calling thread is the last "worker", so start one fewer thread
+    int numWorkers = numThreads - 1;
+    for (int i = 0; i < numWorkers + 1; i++) {
+        queues.push_back(std::make_unique<TaskQueue>());
+    }
+    for (int i = 0; i < numWorkers; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+int ThreadPool::size() const {
+    return static_cast<int>(workers.size()) + 1;
+}
+
+bool ThreadPool::pinned() const {
+    return pinThreads;
+}
+
+void ThreadPool::parallelFor(int begin, int end, int chunkSize, const std::function<void(int, int)>& body) {
+    if (end < begin) {
+        return;
+    }
+    if (chunkSize <= 0) {
+        chunkSize = 1;
+    }
+
+    int numChunks = (end - begin) / chunkSize + 1;
+    int numQueues = static_cast<int>(queues.size());
+    auto group = std::make_shared<TaskGroup>();
+    group->remaining = numChunks;
+
+    // Deal out contiguous runs of chunks so each thread starts on neighbouring rows
+    for (int chunk = 0; chunk < numChunks; chunk++) {
+        int first = begin + chunk * chunkSize;
+        int last = (end - first < chunkSize) ? end : first + chunkSize - 1;
+        int queueIndex = static_cast<int>(static_cast<long long>(chunk) * numQueues / numChunks);
+
+        std::lock_guard<std::mutex> lock(queues[queueIndex]->mutex);
+        queues[queueIndex]->tasks.emplace_back([&body, group, first, last]() {
+            body(first, last);
+            if (group->remaining.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> doneLock(group->mutex);
+                group->done.notify_all();
+            }
+        });
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queuedTasks += numChunks;
+    }
+    wake.notify_all();
+
+    // Help with queued work, then wait for chunks still running on other threads
+    while (group->remaining.load() > 0) {
+        if (!runOneTask(numQueues - 1)) {
+            std::unique_lock<std::mutex> lock(group->mutex);
+            group->done.wait(lock, [&group]() { return group->remaining.load() == 0; });
+        }
+    }
+}
+
+void ThreadPool::parallelForStatic(int begin, int end, int chunkSize, const std::function<void(int, int)>& body) {
+    if (end < begin) {
+        return;
+    }
+    if (chunkSize <= 0) {
+        chunkSize = 1;
+    }
+
+    // Queue q gets chunks [firstChunk(q), firstChunk(q + 1)), the run parallelFor deals it
+    int numChunks = (end - begin) / chunkSize + 1;
+    int numQueues = static_cast<int>(queues.size());
+    auto firstChunk = [numChunks, numQueues](int queueIndex) {
+        return static_cast<int>((static_cast<long long>(queueIndex) * numChunks + numQueues - 1) / numQueues);
+    };
+    auto runChunks = [&body, begin, end, chunkSize](int fromChunk, int toChunk) {
+        for (int chunk = fromChunk; chunk < toChunk; chunk++) {
+            int first = begin + chunk * chunkSize;
+            int last = (end - first < chunkSize) ? end : first + chunkSize - 1;
+            body(first, last);
+        }
+    };
+
+    auto group = std::make_shared<TaskGroup>();
+    for (int queueIndex = 0; queueIndex < numQueues - 1; queueIndex++) {
+        int fromChunk = firstChunk(queueIndex);
+        int toChunk = firstChunk(queueIndex + 1);
+        if (fromChunk == toChunk) {
+            continue;
+        }
+        group->remaining++;
+        {
+            std::lock_guard<std::mutex> lock(queues[queueIndex]->mutex);
+            queues[queueIndex]->ownTasks.emplace_back([&runChunks, group, fromChunk, toChunk]() {
+                runChunks(fromChunk, toChunk);
+                if (group->remaining.fetch_sub(1) == 1) {
+                    std::lock_guard<std::mutex> doneLock(group->mutex);
+                    group->done.notify_all();
+                }
+            });
+        }
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queues[queueIndex]->ownQueued++;
+    }
+    wake.notify_all();
+
+    // The calling thread's share is the last run, then wait for the workers' shares
+    runChunks(firstChunk(numQueues - 1), numChunks);
+    std::unique_lock<std::mutex> lock(group->mutex);
+    group->done.wait(lock, [&group]() { return group->remaining.load() == 0; });
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    // Spread single tasks over the queues so idle workers find them without stealing
+    int queueIndex = static_cast<int>(nextSubmitQueue++ % queues.size());
+    {
+        std::lock_guard<std::mutex> lock(queues[queueIndex]->mutex);
+        queues[queueIndex]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queuedTasks++;
+    }
+    wake.notify_one();
+}
+
+bool ThreadPool::runPendingTask() {
+    return runOneTask(static_cast<int>(queues.size()) - 1);
+}
+
+void ThreadPool::workerLoop(int index) {
+    // A pinned worker keeps running on the node where it first touched its rows
+    if (pinThreads) {
+        pinToCpu(index);
+    }
+
+    while (true) {
+        if (runOneTask(index)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        TaskQueue& own = *queues[index];
+        wake.wait(lock, [this, &own]() { return stopping || queuedTasks.load() > 0 || own.ownQueued.load() > 0; });
+        if (stopping && queuedTasks.load() <= 0 && own.ownQueued.load() <= 0) {
+            return;
+        }
+    }
+}
+
+// Runs one task from our own queue, or steals one from another queue
+bool ThreadPool::runOneTask(int preferredQueue) {
+    std::function<void()> task;
+    if (popOwnTask(preferredQueue, task)) {
+        task();
+        return true;
+    }
+    int numQueues = static_cast<int>(queues.size());
+
+    bool found = popTask(preferredQueue, true, task);
+    for (int i = 1; !found && i < numQueues; i++) {
+        found = popTask((preferredQueue + i) % numQueues, false, task);
+    }
+    if (!found) {
+        return false;
+    }
+
+    queuedTasks--;
+    task();
+    return true;
+}
+
+bool ThreadPool::popOwnTask(int queueIndex, std::function<void()>& task) {
+    TaskQueue& queue = *queues[queueIndex];
+    if (queue.ownQueued.load() <= 0) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.ownTasks.empty()) {
+        return false;
+    }
+    task = std::move(queue.ownTasks.front());
+    queue.ownTasks.pop_front();
+    queue.ownQueued--;
+    return true;
+}
+
+bool ThreadPool::popTask(int queueIndex, bool fromFront, std::function<void()>& task) {
+    TaskQueue& queue = *queues[queueIndex];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    if (fromFront) {
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+    } else {
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+    }
+    return true;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool: threads are started once and reused for every parallelFor.
+// Each worker pops from the front of its own queue and steals from the back of the others,
+// so chunks stay local until a thread runs out of work.
+class ThreadPool {
+    public:
+        // numThreads counts the calling thread, which helps run tasks while it waits
+        // (0 uses std::thread::hardware_concurrency). pinThreads binds worker i to the
+        // i-th CPU the process may run on (Linux only, ignored elsewhere)
+        explicit ThreadPool(int numThreads = 0, bool pinThreads = false);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // Number of threads that run tasks, including the caller of parallelFor
+        int size() const;
+
+        // Whether workers were pinned to CPUs
+        bool pinned() const;
+
+        // Run body(first, last) on [begin, end] split into chunks of chunkSize, blocking until all are done
+        void parallelFor(int begin, int end, int chunkSize, const std::function<void(int, int)>& body);
+
+        // Same as parallelFor, but each thread runs exactly the chunks parallelFor first deals it
+        // and none are stolen, so the same arguments always give a thread the same rows
+        void parallelForStatic(int begin, int end, int chunkSize, const std::function<void(int, int)>& body);
+
+        // Queue a single task to run on some thread of the pool, without waiting for it
+        void submit(std::function<void()> task);
+
+        // Run one queued task on the calling thread, returning false if none was queued.
+        // Lets a thread waiting for submitted work help instead of blocking.
+        bool runPendingTask();
+
+    private:
+        // A queue per worker plus one for the calling thread, each on its own cache line
+        struct alignas(64) TaskQueue {
+            std::mutex mutex;
+            std::deque<std::function<void()>> tasks;
+
+            // Tasks only the queue's own worker may run, counted for its wakeup check
+            std::deque<std::function<void()>> ownTasks;
+            std::atomic<int> ownQueued{0};
+        };
+
+        void workerLoop(int index);
+        bool runOneTask(int preferredQueue);
+        bool popOwnTask(int queueIndex, std::function<void()>& task);
+        bool popTask(int queueIndex, bool fromFront, std::function<void()>& task);
+
+        std::vector<std::thread> workers;
+        std::vector<std::unique_ptr<TaskQueue>> queues;
+
+        // Sleeping workers wait here until queuedTasks is non-zero
+        std::mutex sleepMutex;
+        std::condition_variable wake;
+        std::atomic<int> queuedTasks{0};
+        std::atomic<unsigned> nextSubmitQueue{0};
+        bool stopping = false;
+        bool pinThreads;
+};
@@ -0,0 +1,1005 @@
+#include "CompiledExpression.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+// Batch blocks are compiled a second time for AVX2 on x86 with GCC/Clang
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define EXPRESSION_BATCH_X86
+#endif
+
+// The block loops must be inlined into each evaluator to be compiled for its instruction set
+#if defined(__GNUC__) || defined(__clang__)
+#define BATCH_INLINE inline __attribute__((always_inline))
+#else
+#define BATCH_INLINE inline
+#endif
+
+// Signature of the block evaluators: run the whole tape over points [start, start + count).
+// errors holds the masks of those points, or is null to throw on an error; faults is scratch
+// space like scratch, with a block of masks per register
+using BatchBlockFunction = void (*)(const Instruction* code, std::size_t codeSize, const std::uint32_t* registers,
+                                    std::size_t numRegisters, const double* constants, const double* const* columns,
+                                    std::size_t start, std::size_t count, double* scratch, EvalErrors* faults,
+                                    EvalErrors* errors);
+
+// out[k] = op(left[k], right[k]) for a whole block; out never overlaps the operands
+template <typename Operation>
+static BATCH_INLINE
+void applyBlock(double* __restrict out, const double* __restrict left, const double* __restrict right,
+                Operation op) {
+    for (std::size_t k = 0; k < BATCH_BLOCK; k++) {
+        out[k] = op(left[k], right[k]);
+    }
+}
+
+// out[k] = op(in[k]) for a whole block
+template <typename Operation>
+static BATCH_INLINE
+void applyUnaryBlock(double* __restrict out, const double* __restrict in, Operation op) {
+    for (std::size_t k = 0; k < BATCH_BLOCK; k++) {
+        out[k] = op(in[k]);
+    }
+}
+
+// out[k] = condition[k] > 0 ? ifTrue[k] : ifFalse[k] for a whole block
+static BATCH_INLINE
+void selectBlock(double* __restrict out, const double* __restrict condition, const double* __restrict ifTrue,
+                 const double* __restrict ifFalse) {
+    for (std::size_t k = 0; k < BATCH_BLOCK; k++) {
+        out[k] = condition[k] > 0.0 ? ifTrue[k] : ifFalse[k];
+    }
+}
+
+// Masks of a block: out[k] = left[k] | right[k]
+static BATCH_INLINE
+void orFaultBlock(EvalErrors* __restrict out, const EvalErrors* __restrict left, const EvalErrors* __restrict right) {
+    for (std::size_t k = 0; k < BATCH_BLOCK; k++) {
+        out[k] = left[k] | right[k];
+    }
+}
+
+// Masks of a Select: its condition's and those of the branch it picks
+static BATCH_INLINE
+void selectFaultBlock(EvalErrors* __restrict out, const double* __restrict condition,
+                      const EvalErrors* __restrict conditionFaults, const EvalErrors* __restrict ifTrue,
+                      const EvalErrors* __restrict ifFalse) {
+    for (std::size_t k = 0; k < BATCH_BLOCK; k++) {
+        out[k] = conditionFaults[k] | (condition[k] > 0.0 ? ifTrue[k] : ifFalse[k]);
+    }
+}
+
+// Body shared by every block evaluator. Loops always run over the full BATCH_BLOCK so the
+// compiler can vectorize them; points past count in a short last block are computed and ignored.
+// A division by zero gives NaN; from the first one on, each register also carries a block of
+// error masks (a Select keeps those of its condition and the branch it picks), and the masks
+// that reach the result are reported.
+static BATCH_INLINE
+void evaluateBlockBody(const Instruction* code, std::size_t codeSize, const std::uint32_t* registers,
+                       std::size_t numRegisters, const double* constants, const double* const* columns,
+                       std::size_t start, std::size_t count, double* scratch, EvalErrors* faults,
+                       EvalErrors* errors) {
+    bool tracking = false;
+    for (std::size_t i = 0; i < codeSize; i++) {
+        const Instruction& step = code[i];
+        double* out = scratch + registers[i] * BATCH_BLOCK;
+        auto operand = [scratch, registers](std::uint32_t index) { return scratch + registers[index] * BATCH_BLOCK; };
+
+        switch (step.op) {
+            case OpCode::Constant:
+                std::fill(out, out + BATCH_BLOCK, constants[step.left]);
+                break;
+            case OpCode::Variable:
+                std::copy(columns[step.left] + start, columns[step.left] + start + count, out);
+                break;
+            case OpCode::Add:
+                applyBlock(out, operand(step.left), operand(step.right), [](double a, double b) { return a + b; });
+                break;
+            case OpCode::Sub:
+                applyBlock(out, operand(step.left), operand(step.right), [](double a, double b) { return a - b; });
+                break;
+            case OpCode::Mul:
+                applyBlock(out, operand(step.left), operand(step.right), [](double a, double b) { return a * b; });
+                break;
+            case OpCode::Div: {
+                const double* divisor = operand(step.right);
+                applyBlock(out, operand(step.left), divisor, [](double a, double b) { return a / b; });
+                if (!tracking) {
+                    for (std::size_t k = 0; k < count; k++) {
+                        tracking = tracking || divisor[k] == 0.0;
+                    }
+                    if (tracking) {
+                        std::fill(faults, faults + numRegisters * BATCH_BLOCK, EvalErrors(0));
+                    }
+                }
+                break;
+            }
+            case OpCode::Pow:
+                applyBlock(out, operand(step.left), operand(step.right), [](double a, double b) { return std::pow(a, b); });
+                break;
+            case OpCode::Min:
+                applyBlock(out, operand(step.left), operand(step.right), [](double a, double b) { return b < a ? b : a; });
+                break;
+            case OpCode::Max:
+                applyBlock(out, operand(step.left), operand(step.right), [](double a, double b) { return a < b ? b : a; });
+                break;
+            case OpCode::Exp:
+                applyUnaryBlock(out, operand(step.left), [](double a) { return std::exp(a); });
+                break;
+            case OpCode::Log:
+                applyUnaryBlock(out, operand(step.left), [](double a) { return std::log(a); });
+                break;
+            case OpCode::Sin:
+                applyUnaryBlock(out, operand(step.left), [](double a) { return std::sin(a); });
+                break;
+            case OpCode::Cos:
+                applyUnaryBlock(out, operand(step.left), [](double a) { return std::cos(a); });
+                break;
+            case OpCode::Sqrt:
+                applyUnaryBlock(out, operand(step.left), [](double a) { return std::sqrt(a); });
+                break;
+            case OpCode::Select:
+                selectBlock(out, operand(step.left), operand(step.right), operand(step.third));
+                break;
+        }
+        if (!tracking) {
+            continue;
+        }
+
+        EvalErrors* outFaults = faults + registers[i] * BATCH_BLOCK;
+        auto operandFaults = [faults, registers](std::uint32_t index) { return faults + registers[index] * BATCH_BLOCK; };
+        switch (arity(step.op)) {
+            case 0:
+                std::fill(outFaults, outFaults + BATCH_BLOCK, EvalErrors(0));
+                break;
+            case 1:
+                std::copy(operandFaults(step.left), operandFaults(step.left) + BATCH_BLOCK, outFaults);
+                break;
+            case 2:
+                orFaultBlock(outFaults, operandFaults(step.left), operandFaults(step.right));
+                break;
+            default:
+                selectFaultBlock(outFaults, operand(step.left), operandFaults(step.left), operandFaults(step.right),
+                                 operandFaults(step.third));
+                break;
+        }
+        if (step.op == OpCode::Div) {
+            const double* divisor = operand(step.right);
+            for (std::size_t k = 0; k < count; k++) {
+                if (divisor[k] == 0.0) {
+                    out[k] = std::numeric_limits<double>::quiet_NaN();
+                    outFaults[k] |= EVAL_DIVIDE_BY_ZERO;
+                }
+            }
+        }
+    }
+
+    if (tracking) {
+        const EvalErrors* resultFaults = faults + registers[codeSize - 1] * BATCH_BLOCK;
+        for (std::size_t k = 0; k < count; k++) {
+            if (resultFaults[k] != 0) {
+                evaluationError(errors ? errors + k : nullptr, resultFaults[k], "Cannot divide by 0!");
+            }
+        }
+    }
+}
+
+static void evaluateBlockDefault(const Instruction* code, std::size_t codeSize, const std::uint32_t* registers,
+                                 std::size_t numRegisters, const double* constants, const double* const* columns,
+                                 std::size_t start, std::size_t count, double* scratch, EvalErrors* faults,
+                                 EvalErrors* errors) {
+    evaluateBlockBody(code, codeSize, registers, numRegisters, constants, columns, start, count, scratch, faults, errors);
+}
+
+#ifdef EXPRESSION_BATCH_X86
+__attribute__((target("avx2")))
+static void evaluateBlockAvx2(const Instruction* code, std::size_t codeSize, const std::uint32_t* registers,
+                              std::size_t numRegisters, const double* constants, const double* const* columns,
+                              std::size_t start, std::size_t count, double* scratch, EvalErrors* faults,
+                              EvalErrors* errors) {
+    evaluateBlockBody(code, codeSize, registers, numRegisters, constants, columns, start, count, scratch, faults, errors);
+}
+#endif
+
+// Widest block evaluator this CPU supports, chosen once on first use
+static BatchBlockFunction batchBlockFunction() {
+    static const BatchBlockFunction chosen = []() -> BatchBlockFunction {
+#ifdef EXPRESSION_BATCH_X86
+        if (__builtin_cpu_supports("avx2")) {
+            return evaluateBlockAvx2;
+        }
+#endif
+        return evaluateBlockDefault;
+    }();
+    return chosen;
+}
+
+// Column pointers of a batch given as vectors, checking there is one per slot and that all
+// have the same length, which is stored in n
+static std::vector<const double*> batchColumns(const std::vector<std::vector<double>>& columns, std::size_t numSlots,
+                                               std::size_t& n) {
+    if (columns.size() < numSlots) {
+        throw std::invalid_argument("Expected " + std::to_string(numSlots) + " columns, got "
+                                    + std::to_string(columns.size()));
+    }
+    n = columns.empty() ? 0 : columns[0].size();
+    std::vector<const double*> columnPointers;
+    for (const std::vector<double>& column : columns) {
+        if (column.size() != n) {
+            throw std::invalid_argument("Batch columns must all have the same length");
+        }
+        columnPointers.push_back(column.data());
+    }
+    return columnPointers;
+}
+
+// Fixed start of a serialized record; the tape follows it directly
+struct SerializedHeader {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint32_t codeSize;
+    std::uint32_t constantCount;
+    std::uint32_t slotCount;
+    std::uint32_t namesSize;    // bytes of the name table
+};
+
+// The tape is loaded in place, so its layout is part of the format
+static_assert(sizeof(SerializedHeader) == 24, "Serialized header layout changed");
+static_assert(sizeof(Instruction) == 16, "Instruction layout changed; bump SERIALIZED_VERSION");
+
+static std::size_t alignTo8(std::size_t bytes) {
+    return (bytes + 7) / 8 * 8;
+}
+
+CompiledExpression::CompiledExpression(const node_ptr& root) {
+    if (!root) {
+        throw std::invalid_argument("Cannot compile a null expression");
+    }
+
+    std::vector<Instruction> code;
+    std::vector<double> pool;
+    std::unordered_map<std::string, std::uint32_t> variableIndex;
+
+    // Iterative post-order walk: a binary node is visited once to queue its children and
+    // again, once both are on the tape, to emit itself
+    struct Frame {
+        const Node* node;
+        bool childrenDone;
+    };
+    std::vector<Frame> pending{{root.get(), false}};
+    std::vector<std::uint32_t> operands;
+    std::unordered_map<const Node*, std::uint32_t> emitted;
+
+    while (!pending.empty()) {
+        Frame frame = pending.back();
+        pending.pop_back();
+        const Node* node = frame.node;
+
+        // A node shared by several parents (a DAG, e.g. from NodeFactory) is emitted once
+        auto done = emitted.find(node);
+        if (done != emitted.end()) {
+            operands.push_back(done->second);
+            continue;
+        }
+
+        switch (node->opcode()) {
+            case OpCode::Constant:
+                pool.push_back(static_cast<const Constant*>(node)->getValue());
+                code.push_back({OpCode::Constant, static_cast<std::uint32_t>(pool.size() - 1), 0, 0});
+                break;
+            case OpCode::Variable: {
+                const std::string& name = static_cast<const Variable*>(node)->getName();
+                auto inserted = variableIndex.emplace(name, static_cast<std::uint32_t>(variableNames.size()));
+                if (inserted.second) {
+                    usedSlots.push_back(static_cast<std::uint32_t>(variableNames.size()));
+                    variableNames.push_back(name);
+                }
+                code.push_back({OpCode::Variable, inserted.first->second, 0, 0});
+                break;
+            }
+            default: {
+                std::size_t count = arity(node->opcode());
+                if (!frame.childrenDone) {
+                    pending.push_back({node, true});
+                    for (std::size_t i = count; i-- > 0;) {
+                        pending.push_back({node->child(i).get(), false});
+                    }
+                    continue;
+                }
+                Instruction step{node->opcode(), 0, 0, 0};
+                std::uint32_t* fields[3] = {&step.left, &step.right, &step.third};
+                for (std::size_t i = count; i-- > 0;) {
+                    *fields[i] = operands.back();
+                    operands.pop_back();
+                }
+                code.push_back(step);
+                break;
+            }
+        }
+        operands.push_back(static_cast<std::uint32_t>(code.size() - 1));
+        emitted[node] = static_cast<std::uint32_t>(code.size() - 1);
+    }
+
+    pack(code.data(), code.size(), pool.data(), pool.size());
+}
+
+CompiledExpression::CompiledExpression(const node_ptr& root, const std::vector<std::string>& slotNames)
+    : CompiledExpression(root) {
+    std::unordered_map<std::string, std::uint32_t> slotIndex;
+    for (std::size_t i = 0; i < slotNames.size(); i++) {
+        if (!slotIndex.emplace(slotNames[i], static_cast<std::uint32_t>(i)).second) {
+            throw std::invalid_argument("Variable has more than one slot: " + slotNames[i]);
+        }
+    }
+
+    // Slot of each variable in first-use order
+    std::vector<std::uint32_t> slotOf(variableNames.size());
+    for (std::size_t i = 0; i < variableNames.size(); i++) {
+        auto itr = slotIndex.find(variableNames[i]);
+        if (itr == slotIndex.end()) {
+            throw std::invalid_argument("Variable has no slot: " + variableNames[i]);
+        }
+        slotOf[i] = itr->second;
+    }
+
+    // The arena is ours, so the tape can be renumbered in place
+    Instruction* code = reinterpret_cast<Instruction*>(arena.get());
+    for (std::size_t i = 0; i < codeSize; i++) {
+        if (code[i].op == OpCode::Variable) {
+            code[i].left = slotOf[code[i].left];
+        }
+    }
+    usedSlots = slotOf;
+    variableNames = slotNames;
+}
+
+CompiledExpression::CompiledExpression(const CompiledExpression& other)
+    : variableNames(other.variableNames), usedSlots(other.usedSlots) {
+    pack(other.instructions, other.codeSize, other.constants, other.constantCount);
+}
+
+CompiledExpression& CompiledExpression::operator=(const CompiledExpression& other) {
+    if (this != &other) {
+        variableNames = other.variableNames;
+        usedSlots = other.usedSlots;
+        pack(other.instructions, other.codeSize, other.constants, other.constantCount);
+    }
+    return *this;
+}
+
+void CompiledExpression::serialize(std::vector<unsigned char>& out) const {
+    std::size_t namesSize = 0;
+    for (const std::string& name : variableNames) {
+        namesSize += sizeof(std::uint32_t) + name.size();
+    }
+    std::size_t codeOffset = sizeof(SerializedHeader);
+    std::size_t poolOffset = alignTo8(codeOffset + codeSize * sizeof(Instruction));
+    std::size_t namesOffset = poolOffset + constantCount * sizeof(double);
+    std::size_t total = alignTo8(namesOffset + namesSize);
+
+    std::size_t base = out.size();
+    out.resize(base + total, 0);
+    unsigned char* record = out.data() + base;
+
+    SerializedHeader header{SERIALIZED_MAGIC, SERIALIZED_VERSION, static_cast<std::uint32_t>(codeSize),
+                            static_cast<std::uint32_t>(constantCount), static_cast<std::uint32_t>(variableNames.size()),
+                            static_cast<std::uint32_t>(namesSize)};
+    std::memcpy(record, &header, sizeof(header));
+
+    // Field by field, so the padding after op is written as zeros
+    for (std::size_t i = 0; i < codeSize; i++) {
+        Instruction step;
+        std::memset(&step, 0, sizeof(step));
+        step.op = instructions[i].op;
+        step.left = instructions[i].left;
+        step.right = instructions[i].right;
+        step.third = instructions[i].third;
+        std::memcpy(record + codeOffset + i * sizeof(Instruction), &step, sizeof(step));
+    }
+    if (constantCount > 0) {
+        std::memcpy(record + poolOffset, constants, constantCount * sizeof(double));
+    }
+
+    // Each name as its length followed by its characters
+    unsigned char* name = record + namesOffset;
+    for (const std::string& variable : variableNames) {
+        std::uint32_t length = static_cast<std::uint32_t>(variable.size());
+        std::memcpy(name, &length, sizeof(length));
+        std::memcpy(name + sizeof(length), variable.data(), variable.size());
+        name += sizeof(length) + variable.size();
+    }
+}
+
+CompiledExpression CompiledExpression::load(const unsigned char* data, std::size_t size, std::size_t* consumed) {
+    SerializedHeader header;
+    if (size < sizeof(header)) {
+        throw std::invalid_argument("Serialized expression is truncated");
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (header.magic != SERIALIZED_MAGIC) {
+        throw std::invalid_argument("Not a serialized expression, or written with the other byte order");
+    }
+    if (header.version != SERIALIZED_VERSION) {
+        throw std::invalid_argument("Unsupported serialized expression version " + std::to_string(header.version));
+    }
+    if (header.codeSize == 0) {
+        throw std::invalid_argument("Serialized expression has an empty tape");
+    }
+    std::size_t codeOffset = sizeof(SerializedHeader);
+    std::size_t poolOffset = alignTo8(codeOffset + std::size_t(header.codeSize) * sizeof(Instruction));
+    std::size_t namesOffset = poolOffset + std::size_t(header.constantCount) * sizeof(double);
+    std::size_t total = alignTo8(namesOffset + header.namesSize);
+    if (total > size) {
+        throw std::invalid_argument("Serialized expression is truncated");
+    }
+    if (header.slotCount > header.namesSize / sizeof(std::uint32_t)) {
+        throw std::invalid_argument("Serialized expression has a malformed name table");
+    }
+
+    CompiledExpression expression;
+    expression.variableNames.reserve(header.slotCount);
+    expression.usedSlots.reserve(header.slotCount);
+    const unsigned char* name = data + namesOffset;
+    const unsigned char* namesEnd = name + header.namesSize;
+    for (std::uint32_t slot = 0; slot < header.slotCount; slot++) {
+        std::uint32_t length;
+        if (static_cast<std::size_t>(namesEnd - name) < sizeof(length)) {
+            throw std::invalid_argument("Serialized expression has a malformed name table");
+        }
+        std::memcpy(&length, name, sizeof(length));
+        name += sizeof(length);
+        if (static_cast<std::size_t>(namesEnd - name) < length) {
+            throw std::invalid_argument("Serialized expression has a malformed name table");
+        }
+        expression.variableNames.emplace_back(reinterpret_cast<const char*>(name), length);
+        name += length;
+    }
+    if (name != namesEnd) {
+        throw std::invalid_argument("Serialized expression has a malformed name table");
+    }
+
+    // Every operand must name an earlier instruction, a constant or a slot that exists
+    std::vector<bool> slotUsed(header.slotCount, false);
+    for (std::uint32_t i = 0; i < header.codeSize; i++) {
+        Instruction step;
+        std::memcpy(&step, data + codeOffset + std::size_t(i) * sizeof(Instruction), sizeof(step));
+        bool valid;
+        switch (step.op) {
+            case OpCode::Constant:
+                valid = step.left < header.constantCount;
+                break;
+            case OpCode::Variable:
+                valid = step.left < header.slotCount;
+                if (valid && !slotUsed[step.left]) {
+                    slotUsed[step.left] = true;
+                    expression.usedSlots.push_back(step.left);
+                }
+                break;
+            default:
+                valid = step.op <= OpCode::Select;
+                for (std::size_t k = 0; valid && k < arity(step.op); k++) {
+                    valid = step.operand(k) < i;
+                }
+                break;
+        }
+        if (!valid) {
+            throw std::invalid_argument("Serialized expression has a malformed instruction " + std::to_string(i));
+        }
+    }
+
+    if (reinterpret_cast<std::uintptr_t>(data) % alignof(double) == 0) {
+        // Use the tape and constants where they are
+        expression.instructions = reinterpret_cast<const Instruction*>(data + codeOffset);
+        expression.codeSize = header.codeSize;
+        expression.constants = reinterpret_cast<const double*>(data + poolOffset);
+        expression.constantCount = header.constantCount;
+        expression.prepare();
+    } else {
+        std::vector<Instruction> code(header.codeSize);
+        std::vector<double> pool(header.constantCount);
+        std::memcpy(code.data(), data + codeOffset, code.size() * sizeof(Instruction));
+        if (!pool.empty()) {
+            std::memcpy(pool.data(), data + poolOffset, pool.size() * sizeof(double));
+        }
+        expression.pack(code.data(), code.size(), pool.data(), pool.size());
+    }
+
+    if (consumed) {
+        *consumed = total;
+    }
+    return expression;
+}
+
+std::vector<CompiledExpression> CompiledExpression::loadAll(const unsigned char* data, std::size_t size) {
+    // Count the records first so the result is allocated once
+    std::size_t count = 0;
+    for (std::size_t offset = 0; offset + sizeof(SerializedHeader) <= size; count++) {
+        SerializedHeader header;
+        std::memcpy(&header, data + offset, sizeof(header));
+        offset += alignTo8(alignTo8(sizeof(header) + std::size_t(header.codeSize) * sizeof(Instruction))
+                           + std::size_t(header.constantCount) * sizeof(double) + header.namesSize);
+    }
+
+    std::vector<CompiledExpression> expressions;
+    expressions.reserve(count);
+    std::size_t offset = 0;
+    while (offset < size) {
+        std::size_t consumed;
+        expressions.push_back(load(data + offset, size - offset, &consumed));
+        offset += consumed;
+    }
+    return expressions;
+}
+
+void CompiledExpression::pack(const Instruction* code, std::size_t codeCount, const double* pool, std::size_t poolCount) {
+    // Instructions first, then the constants at the next 8-byte boundary
+    std::size_t codeBytes = codeCount * sizeof(Instruction);
+    std::size_t poolOffset = (codeBytes + alignof(double) - 1) / alignof(double) * alignof(double);
+    arena.reset(new unsigned char[poolOffset + poolCount * sizeof(double)]);
+    if (codeCount > 0) {
+        std::memcpy(arena.get(), code, codeBytes);
+    }
+    if (poolCount > 0) {
+        std::memcpy(arena.get() + poolOffset, pool, poolCount * sizeof(double));
+    }
+
+    instructions = reinterpret_cast<const Instruction*>(arena.get());
+    codeSize = codeCount;
+    constants = reinterpret_cast<const double*>(arena.get() + poolOffset);
+    constantCount = poolCount;
+    prepare();
+}
+
+void CompiledExpression::prepare() {
+    // Evaluation scratch is sized on first use, so loading many expressions stays cheap
+    values.clear();
+    slotValues.clear();
+    adjoints.clear();
+    allocateRegisters();
+}
+
+void CompiledExpression::allocateRegisters() {
+    // Last instruction that reads each value
+    std::vector<std::size_t> lastUse(codeSize);
+    for (std::size_t i = 0; i < codeSize; i++) {
+        lastUse[i] = i;
+        const Instruction& step = instructions[i];
+        for (std::size_t k = 0; k < arity(step.op); k++) {
+            lastUse[step.operand(k)] = i;
+        }
+    }
+
+    // Linear scan: an instruction's block is taken before its operands' blocks are released,
+    // so an output never shares a block with an input
+    registers.assign(codeSize, 0);
+    numRegisters = 0;
+    std::vector<std::uint32_t> freeRegisters;
+    for (std::size_t i = 0; i < codeSize; i++) {
+        if (freeRegisters.empty()) {
+            registers[i] = numRegisters++;
+        } else {
+            registers[i] = freeRegisters.back();
+            freeRegisters.pop_back();
+        }
+
+        // An operand read more than once by this instruction is released once
+        const Instruction& step = instructions[i];
+        for (std::size_t k = 0; k < arity(step.op); k++) {
+            std::uint32_t used = step.operand(k);
+            bool repeated = (k > 0 && used == step.left) || (k > 1 && used == step.right);
+            if (lastUse[used] == i && !repeated) {
+                freeRegisters.push_back(registers[used]);
+            }
+        }
+        if (lastUse[i] == i && i + 1 < codeSize) {
+            freeRegisters.push_back(registers[i]);
+        }
+    }
+}
+
+double CompiledExpression::evaluate(const double* slots) const {
+    return run(slots);
+}
+
+double CompiledExpression::evaluate(const std::vector<double>& slots) const {
+    if (slots.size() < variableNames.size()) {
+        throw std::invalid_argument("Expected " + std::to_string(variableNames.size()) + " slot values, got "
+                                    + std::to_string(slots.size()));
+    }
+    return run(slots.data());
+}
+
+double CompiledExpression::tryEvaluate(const double* slots, EvalErrors& errors) const {
+    return run(slots, &errors);
+}
+
+double CompiledExpression::tryEvaluate(const double* slots, const EvalErrors* slotFaults, EvalErrors& errors) const {
+    return run(slots, &errors, slotFaults);
+}
+
+double CompiledExpression::evaluate(const SymbolTable& symbols) const {
+    const EvalErrors* slotFaults = bindSlotValues(symbols);
+    return run(slotValues.data(), nullptr, slotFaults);
+}
+
+double CompiledExpression::tryEvaluate(const SymbolTable& symbols, EvalErrors& errors) const {
+    const EvalErrors* slotFaults = bindSlotValues(symbols);
+    return run(slotValues.data(), &errors, slotFaults);
+}
+
+double CompiledExpression::gradient(const double* slots, double* gradient) const {
+    double result = run(slots);
+    std::fill(gradient, gradient + variableNames.size(), 0.0);
+    adjoints.assign(codeSize, 0.0);
+    adjoints[codeSize - 1] = 1.0;
+
+    // Walk the tape backwards, passing each instruction's adjoint on to its operands
+    const double* value = values.data();
+    double* adjoint = adjoints.data();
+    for (std::size_t i = codeSize; i-- > 0;) {
+        const Instruction& step = instructions[i];
+        double seed = adjoint[i];
+        if (seed == 0.0) {
+            // Nothing to pass on, and no 0 * inf from a branch no Select picked
+            continue;
+        }
+        switch (step.op) {
+            case OpCode::Constant:
+                break;
+            case OpCode::Variable:
+                gradient[step.left] += seed;
+                break;
+            case OpCode::Add:
+                adjoint[step.left] += seed;
+                adjoint[step.right] += seed;
+                break;
+            case OpCode::Sub:
+                adjoint[step.left] += seed;
+                adjoint[step.right] -= seed;
+                break;
+            case OpCode::Mul:
+                adjoint[step.left] += seed * value[step.right];
+                adjoint[step.right] += seed * value[step.left];
+                break;
+            case OpCode::Div:
+                // d(u/v) = du / v - (u/v) dv / v
+                adjoint[step.left] += seed / value[step.right];
+                adjoint[step.right] -= seed * value[i] / value[step.right];
+                break;
+            case OpCode::Pow:
+                // d(u^v) = v u^(v-1) du + u^v log(u) dv. Zero terms are skipped rather than
+                // computed as 0 * inf, and so is dv for a constant v (its adjoint is never used),
+                // so a negative u does not make it NaN
+                if (value[step.right] != 0.0) {
+                    adjoint[step.left] += seed * value[step.right] * std::pow(value[step.left], value[step.right] - 1.0);
+                }
+                if (instructions[step.right].op != OpCode::Constant && value[i] != 0.0) {
+                    adjoint[step.right] += seed * value[i] * std::log(value[step.left]);
+                }
+                break;
+            case OpCode::Min:
+                adjoint[value[step.right] < value[step.left] ? step.right : step.left] += seed;
+                break;
+            case OpCode::Max:
+                adjoint[value[step.left] < value[step.right] ? step.right : step.left] += seed;
+                break;
+            case OpCode::Exp:
+                adjoint[step.left] += seed * value[i];
+                break;
+            case OpCode::Log:
+                adjoint[step.left] += seed / value[step.left];
+                break;
+            case OpCode::Sin:
+                adjoint[step.left] += seed * std::cos(value[step.left]);
+                break;
+            case OpCode::Cos:
+                adjoint[step.left] -= seed * std::sin(value[step.left]);
+                break;
+            case OpCode::Sqrt:
+                adjoint[step.left] += seed * 0.5 / value[i];
+                break;
+            case OpCode::Select:
+                adjoint[value[step.left] > 0.0 ? step.right : step.third] += seed;
+                break;
+        }
+    }
+    return result;
+}
+
+SymbolTable CompiledExpression::gradient(const SymbolTable& symbols, double* value) const {
+    slotValues.resize(variableNames.size());
+    bindOrThrow(symbols, slotValues.data());
+    std::vector<double> partials(variableNames.size());
+    double result = gradient(slotValues.data(), partials.data());
+    if (value) {
+        *value = result;
+    }
+
+    SymbolTable named;
+    for (std::uint32_t slot : usedSlots) {
+        named[variableNames[slot]] = partials[slot];
+    }
+    return named;
+}
+
+// Pool for the numThreads batch overloads, or null if the n points fit in one block or one
+// thread was asked for. There is one pool per thread count, kept so later calls reuse its threads.
+static ThreadPool* batchPool(int numThreads, std::size_t n) {
+    if (numThreads == 1 || n <= BATCH_BLOCK) {
+        return nullptr;
+    }
+    static std::mutex poolsMutex;
+    static std::map<int, std::unique_ptr<ThreadPool>> pools;
+    std::lock_guard<std::mutex> lock(poolsMutex);
+    std::unique_ptr<ThreadPool>& pool = pools[std::max(numThreads, 0)];
+    if (!pool) {
+        pool = std::make_unique<ThreadPool>(numThreads);
+    }
+    return pool.get();
+}
+
+void CompiledExpression::evaluateBatch(const double* const* columns, std::size_t n, double* results,
+                                       int numThreads) const {
+    runBatch(columns, n, results, nullptr, batchPool(numThreads, n));
+}
+
+void CompiledExpression::evaluateBatch(const double* const* columns, std::size_t n, double* results,
+                                       ThreadPool& pool) const {
+    runBatch(columns, n, results, nullptr, &pool);
+}
+
+void CompiledExpression::tryEvaluateBatch(const double* const* columns, std::size_t n, double* results,
+                                          EvalErrors* errors, int numThreads) const {
+    std::fill(errors, errors + n, EvalErrors(0));
+    runBatch(columns, n, results, errors, batchPool(numThreads, n));
+}
+
+void CompiledExpression::tryEvaluateBatch(const double* const* columns, std::size_t n, double* results,
+                                          EvalErrors* errors, ThreadPool& pool) const {
+    std::fill(errors, errors + n, EvalErrors(0));
+    runBatch(columns, n, results, errors, &pool);
+}
+
+void CompiledExpression::runBatch(const double* const* columns, std::size_t n, double* results, EvalErrors* errors,
+                                  ThreadPool* pool) const {
+    if (n == 0) {
+        return;
+    }
+    std::size_t numBlocks = (n + BATCH_BLOCK - 1) / BATCH_BLOCK;
+    std::size_t numRuns = pool ? std::min<std::size_t>(pool->size(), numBlocks) : 1;
+    BatchBlockFunction evaluateBlock = batchBlockFunction();
+    std::uint32_t result = registers[codeSize - 1];
+
+    // Blocks [firstBlock, lastBlock) with this thread's own scratch space
+    auto evaluateBlocks = [&](std::size_t firstBlock, std::size_t lastBlock) {
+        std::vector<double> scratch(static_cast<std::size_t>(numRegisters) * BATCH_BLOCK, 0.0);
+        std::vector<EvalErrors> faults(static_cast<std::size_t>(numRegisters) * BATCH_BLOCK);
+        for (std::size_t block = firstBlock; block < lastBlock; block++) {
+            std::size_t start = block * BATCH_BLOCK;
+            std::size_t count = std::min(BATCH_BLOCK, n - start);
+            evaluateBlock(instructions, codeSize, registers.data(), numRegisters, constants, columns, start, count,
+                          scratch.data(), faults.data(), errors ? errors + start : nullptr);
+            std::copy(scratch.data() + result * BATCH_BLOCK, scratch.data() + result * BATCH_BLOCK + count,
+                      results + start);
+        }
+    };
+
+    if (numRuns == 1) {
+        evaluateBlocks(0, numBlocks);
+        return;
+    }
+
+    // A contiguous run of blocks per thread, the last on the calling thread; when throwing, the
+    // first error is rethrown once every run has finished
+    std::vector<std::exception_ptr> failures(numRuns);
+    std::atomic<std::size_t> remaining{numRuns};
+    std::mutex doneMutex;
+    std::condition_variable done;
+    auto runBlocks = [&](std::size_t run) {
+        try {
+            evaluateBlocks(numBlocks * run / numRuns, numBlocks * (run + 1) / numRuns);
+        } catch (...) {
+            failures[run] = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock(doneMutex);
+        remaining--;
+        done.notify_all();
+    };
+    for (std::size_t run = 0; run + 1 < numRuns; run++) {
+        pool->submit([&runBlocks, run]() { runBlocks(run); });
+    }
+    runBlocks(numRuns - 1);
+
+    // Help with runs still queued (a one-thread pool has no workers), then wait for the rest.
+    // The last run decrements under doneMutex, so taking it once more means no run still uses it.
+    while (remaining.load() > 0) {
+        if (!pool->runPendingTask()) {
+            std::unique_lock<std::mutex> lock(doneMutex);
+            done.wait(lock, [&remaining]() { return remaining.load() == 0; });
+        }
+    }
+    std::lock_guard<std::mutex> lock(doneMutex);
+    for (const std::exception_ptr& error : failures) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+std::vector<double> CompiledExpression::evaluateBatch(const std::vector<std::vector<double>>& columns,
+                                                      int numThreads) const {
+    std::size_t n = 0;
+    std::vector<const double*> columnPointers = batchColumns(columns, variableNames.size(), n);
+    std::vector<double> results(n);
+    evaluateBatch(columnPointers.data(), n, results.data(), numThreads);
+    return results;
+}
+
+std::vector<double> CompiledExpression::tryEvaluateBatch(const std::vector<std::vector<double>>& columns,
+                                                         std::vector<EvalErrors>& errors, int numThreads) const {
+    std::size_t n = 0;
+    std::vector<const double*> columnPointers = batchColumns(columns, variableNames.size(), n);
+    std::vector<double> results(n);
+    errors.resize(n);
+    tryEvaluateBatch(columnPointers.data(), n, results.data(), errors.data(), numThreads);
+    return results;
+}
+
+std::vector<double> CompiledExpression::bind(const SymbolTable& symbols) const {
+    std::vector<double> slots(variableNames.size(), 0.0);
+    bindOrThrow(symbols, slots.data());
+    return slots;
+}
+
+bool CompiledExpression::bindInto(const SymbolTable& symbols, double* slots, EvalErrors* slotFaults) const {
+    bool found = true;
+    for (std::uint32_t slot : usedSlots) {
+        auto itr = symbols.find(variableNames[slot]);
+        if (itr != symbols.end()) {
+            slots[slot] = itr->second;
+            continue;
+        }
+        slots[slot] = std::numeric_limits<double>::quiet_NaN();
+        if (slotFaults) {
+            slotFaults[slot] |= EVAL_MISSING_VARIABLE;
+        }
+        found = false;
+    }
+    return found;
+}
+
+void CompiledExpression::bindOrThrow(const SymbolTable& symbols, double* slots) const {
+    if (bindInto(symbols, slots)) {
+        return;
+    }
+    for (std::uint32_t slot : usedSlots) {
+        if (symbols.find(variableNames[slot]) == symbols.end()) {
+            evaluationError(nullptr, EVAL_MISSING_VARIABLE, "Variable value not found for: " + variableNames[slot]);
+        }
+    }
+}
+
+const EvalErrors* CompiledExpression::bindSlotValues(const SymbolTable& symbols) const {
+    slotValues.resize(variableNames.size());
+    if (bindInto(symbols, slotValues.data())) {
+        return nullptr;
+    }
+
+    // A missing variable is only an error if the result depends on it: bind again noting which
+    slotErrors.assign(variableNames.size(), 0);
+    bindInto(symbols, slotValues.data(), slotErrors.data());
+    return slotErrors.data();
+}
+
+double CompiledExpression::run(const double* slots, EvalErrors* errors, const EvalErrors* slotFaults) const {
+    values.resize(codeSize);
+    bool faulted = false;
+    double* value = values.data();
+    for (std::size_t i = 0; i < codeSize; i++) {
+        const Instruction& step = instructions[i];
+        switch (step.op) {
+            case OpCode::Constant:
+                value[i] = constants[step.left];
+                break;
+            case OpCode::Variable:
+                value[i] = slots[step.left];
+                break;
+            case OpCode::Add:
+                value[i] = value[step.left] + value[step.right];
+                break;
+            case OpCode::Sub:
+                value[i] = value[step.left] - value[step.right];
+                break;
+            case OpCode::Mul:
+                value[i] = value[step.left] * value[step.right];
+                break;
+            case OpCode::Div:
+                if (value[step.right] == 0.0) {
+                    value[i] = std::numeric_limits<double>::quiet_NaN();
+                    faulted = true;
+                } else {
+                    value[i] = value[step.left] / value[step.right];
+                }
+                break;
+            case OpCode::Pow:
+                value[i] = std::pow(value[step.left], value[step.right]);
+                break;
+            case OpCode::Min:
+                value[i] = std::min(value[step.left], value[step.right]);
+                break;
+            case OpCode::Max:
+                value[i] = std::max(value[step.left], value[step.right]);
+                break;
+            case OpCode::Exp:
+                value[i] = std::exp(value[step.left]);
+                break;
+            case OpCode::Log:
+                value[i] = std::log(value[step.left]);
+                break;
+            case OpCode::Sin:
+                value[i] = std::sin(value[step.left]);
+                break;
+            case OpCode::Cos:
+                value[i] = std::cos(value[step.left]);
+                break;
+            case OpCode::Sqrt:
+                value[i] = std::sqrt(value[step.left]);
+                break;
+            case OpCode::Select:
+                value[i] = value[step.left] > 0.0 ? value[step.right] : value[step.third];
+                break;
+        }
+    }
+    for (std::size_t k = 0; slotFaults && !faulted && k < usedSlots.size(); k++) {
+        faulted = slotFaults[usedSlots[k]] != 0;
+    }
+    if (faulted) {
+        reportFaults(errors, slotFaults);
+    }
+    return value[codeSize - 1];
+}
+
+void CompiledExpression::reportFaults(EvalErrors* errors, const EvalErrors* slotFaults) const {
+    // Walk back from the result; a Select depends on its condition and the branch it picked
+    const double* value = values.data();
+    std::vector<bool> live(codeSize, false);
+    live[codeSize - 1] = true;
+    for (std::size_t i = codeSize; i-- > 0;) {
+        const Instruction& step = instructions[i];
+        if (!live[i]) {
+            continue;
+        }
+        if (step.op == OpCode::Select) {
+            live[step.left] = true;
+            live[value[step.left] > 0.0 ? step.right : step.third] = true;
+            continue;
+        }
+        for (std::size_t k = 0; k < arity(step.op); k++) {
+            live[step.operand(k)] = true;
+        }
+    }
+
+    for (std::size_t i = 0; i < codeSize; i++) {
+        const Instruction& step = instructions[i];
+        if (!live[i]) {
+            continue;
+        }
+        if (step.op == OpCode::Div && value[step.right] == 0.0) {
+            evaluationError(errors, EVAL_DIVIDE_BY_ZERO, "Cannot divide by 0!");
+        } else if (step.op == OpCode::Variable && slotFaults && slotFaults[step.left] != 0) {
+            EvalErrors fault = slotFaults[step.left];
+            evaluationError(errors, fault,
+                            fault & EVAL_MISSING_VARIABLE ? "Variable value not found for: " + variableNames[step.left]
+                                                          : std::string("Cannot divide by 0!"));
+        }
+    }
+}
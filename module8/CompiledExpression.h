@@ -0,0 +1,201 @@
+#pragma once
+#include "ExpressionTree.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+// One step of a compiled expression. The value of instruction i is stored in slot i of the
+// evaluation buffer; operands always refer to earlier instructions (post-order).
+struct Instruction {
+    OpCode op;
+    std::uint32_t left;     // Constant: constant pool index, Variable: slot, else first operand
+    std::uint32_t right;    // second operand of a binary operation or Select
+    std::uint32_t third;    // third operand of a Select
+
+    // Operand k, for k < arity(op)
+    std::uint32_t operand(std::size_t k) const { return k == 0 ? left : k == 1 ? right : third; }
+};
+
+// First word of a serialized expression; reads differently on a machine of the other byte order
+const std::uint32_t SERIALIZED_MAGIC = 0x54505845;     // "EXPT" in little-endian
+const std::uint32_t SERIALIZED_VERSION = 2;
+
+// Points evaluated together by evaluateBatch: each instruction runs over a block this long
+const std::size_t BATCH_BLOCK = 256;
+
+// Expression tree flattened into a linear tape of instructions in post-order. The tape and
+// its constant pool live in one allocation, and evaluate is a single switch loop over it,
+// with no virtual calls or pointer chasing. The node_ptr tree is still used to build it.
+//
+// Variables are resolved to integer slots when the tape is built, so evaluation reads a dense
+// array of values instead of searching a SymbolTable for every variable leaf.
+//
+// evaluate reuses a buffer owned by the object, so one object must not be evaluated from
+// several threads at once (compile or copy one per thread).
+class CompiledExpression {
+    public:
+        // Flatten a tree (iteratively, so deep trees cannot overflow the stack). A node reached
+        // through several parents is emitted once, so a DAG compiles to one step per distinct node
+        // Variables get slots in the order they first appear (see variables())
+        explicit CompiledExpression(const node_ptr& root);
+
+        // Variables get the slots of their names in slotNames. Throws std::invalid_argument if
+        // a variable of the tree has no slot, so a missing name is caught here, not mid-evaluation
+        CompiledExpression(const node_ptr& root, const std::vector<std::string>& slotNames);
+
+        CompiledExpression(const CompiledExpression& other);
+        CompiledExpression& operator=(const CompiledExpression& other);
+        CompiledExpression(CompiledExpression&&) noexcept = default;
+        CompiledExpression& operator=(CompiledExpression&&) noexcept = default;
+
+        // Append the binary form to out: a header, the tape, the constant pool and the slot names,
+        // laid out exactly as in memory and padded to 8 bytes, so records can be concatenated
+        void serialize(std::vector<unsigned char>& out) const;
+
+        // Expression from the record at data, which must stay alive and unchanged while the result
+        // (or anything moved from it) is used: the tape and constants are not copied but used in
+        // place when data is 8-byte aligned (else copied). The record's length is stored in
+        // *consumed if it is not null. Throws std::invalid_argument for a malformed record
+        static CompiledExpression load(const unsigned char* data, std::size_t size, std::size_t* consumed = nullptr);
+
+        // Every record of a buffer written by consecutive serialize calls
+        static std::vector<CompiledExpression> loadAll(const unsigned char* data, std::size_t size);
+
+        // Evaluate with slots[i] as the value of the variable in slot i
+        double evaluate(const double* slots) const;
+
+        // Same as above; throws std::invalid_argument if there are fewer values than slots
+        double evaluate(const std::vector<double>& slots) const;
+
+        // Evaluate without throwing on a division by zero: it gives NaN and adds
+        // EVAL_DIVIDE_BY_ZERO to errors, as Node::tryEvaluate does
+        double tryEvaluate(const double* slots, EvalErrors& errors) const;
+
+        // Same as above where slotFaults[i] holds the errors that already made the value of slot i
+        // NaN (such as the result of another tryEvaluate); they are added to errors only if that
+        // value reaches the result
+        double tryEvaluate(const double* slots, const EvalErrors* slotFaults, EvalErrors& errors) const;
+
+        // Value and gradient in one forward and one backward (reverse-mode) sweep over the tape:
+        // gradient[i] receives the partial derivative with respect to slot i. Costs a small
+        // constant times one evaluation however many variables there are
+        double gradient(const double* slots, double* gradient) const;
+
+        // Same as above with a symbol table; returns the partial derivative for each variable
+        // of the expression, and stores the value in *value if it is not null
+        SymbolTable gradient(const SymbolTable& symbols, double* value = nullptr) const;
+
+        // Evaluate at n points: slot i at point k is columns[i][k], and the value at point k is
+        // written to results[k]. Each instruction runs over a block of BATCH_BLOCK points at a
+        // time in vectorized loops (AVX2 where the CPU has it), so dispatch is paid per block,
+        // not per point. Blocks are split over numThreads threads (0 uses one per core), taken
+        // from a pool started the first time that count is asked for. Safe to call from several
+        // threads at once.
+        void evaluateBatch(const double* const* columns, std::size_t n, double* results, int numThreads = 1) const;
+
+        // Same as above with the blocks split over the threads of pool
+        void evaluateBatch(const double* const* columns, std::size_t n, double* results, ThreadPool& pool) const;
+
+        // Same as above with one vector per slot, all of the same length
+        std::vector<double> evaluateBatch(const std::vector<std::vector<double>>& columns, int numThreads = 1) const;
+
+        // Evaluate at n points without throwing, so one bad point does not lose the others:
+        // errors[k] is the mask of errors at point k (0 if none), and a division by zero gives
+        // NaN in place of its value, as Node::tryEvaluate does
+        void tryEvaluateBatch(const double* const* columns, std::size_t n, double* results, EvalErrors* errors,
+                              int numThreads = 1) const;
+
+        // Same as above with the blocks split over the threads of pool
+        void tryEvaluateBatch(const double* const* columns, std::size_t n, double* results, EvalErrors* errors,
+                              ThreadPool& pool) const;
+
+        // Same as above with one vector per slot; errors is resized to the number of points
+        std::vector<double> tryEvaluateBatch(const std::vector<std::vector<double>>& columns,
+                                             std::vector<EvalErrors>& errors, int numThreads = 1) const;
+
+        // Evaluate with a symbol table; each variable is looked up once per call
+        double evaluate(const SymbolTable& symbols) const;
+
+        // Same as above without throwing; a missing variable is NaN and adds EVAL_MISSING_VARIABLE
+        // (in both, a variable missing only from a branch that no Select picks is not an error)
+        double tryEvaluate(const SymbolTable& symbols, EvalErrors& errors) const;
+
+        // Slot values taken from a symbol table, for repeated evaluation with the same values.
+        // Throws std::runtime_error if a variable of the expression is missing; slots the
+        // expression does not use are left at zero
+        std::vector<double> bind(const SymbolTable& symbols) const;
+
+        // Number of slots evaluate reads
+        std::size_t numSlots() const { return variableNames.size(); }
+
+        // Number of instructions on the tape
+        std::size_t size() const { return codeSize; }
+
+        // The tape, its constant pool and the variable name of each slot
+        const Instruction* code() const { return instructions; }
+        const double* constantPool() const { return constants; }
+        std::size_t numConstants() const { return constantCount; }
+        const std::vector<std::string>& variables() const { return variableNames; }
+
+    private:
+        CompiledExpression() = default;
+
+        // Copy the tape and constants into a single arena
+        void pack(const Instruction* code, std::size_t codeCount, const double* pool, std::size_t poolCount);
+
+        // Set up the current tape for evaluation
+        void prepare();
+
+        // Give each instruction a block of batch scratch space, reusing blocks whose value is
+        // no longer needed, so scratch grows with the tree's depth rather than its size
+        void allocateRegisters();
+
+        // Look up each used slot's variable in symbols, returning false if any is missing. A missing
+        // one is NaN, with EVAL_MISSING_VARIABLE in its slotFaults entry if slotFaults is given
+        bool bindInto(const SymbolTable& symbols, double* slots, EvalErrors* slotFaults = nullptr) const;
+
+        // Same as bindInto, throwing for the first missing variable
+        void bindOrThrow(const SymbolTable& symbols, double* slots) const;
+
+        // Bind symbols into slotValues, returning the slot faults to run with: null unless a
+        // variable is missing, so the common case neither fills nor scans slotErrors
+        const EvalErrors* bindSlotValues(const SymbolTable& symbols) const;
+
+        // Run the tape with slot i holding slots[i]; errors as in evaluationError. Faults are only
+        // reported if the result depends on them, which is checked after the run
+        double run(const double* slots, EvalErrors* errors = nullptr, const EvalErrors* slotFaults = nullptr) const;
+
+        // Report, in tape order, each fault the result depends on through the branches its
+        // Selects picked (after a run that found one)
+        void reportFaults(EvalErrors* errors, const EvalErrors* slotFaults) const;
+
+        // evaluateBatch, throwing if errors is null, else filling in a mask per point. Runs on
+        // the calling thread alone if pool is null
+        void runBatch(const double* const* columns, std::size_t n, double* results, EvalErrors* errors,
+                      ThreadPool* pool) const;
+
+        // Holds the tape and constants, unless they are viewed in place in a loaded buffer
+        std::unique_ptr<unsigned char[]> arena;
+        const Instruction* instructions = nullptr;
+        std::size_t codeSize = 0;
+        const double* constants = nullptr;
+        std::size_t constantCount = 0;
+        std::vector<std::string> variableNames;
+        std::vector<std::uint32_t> usedSlots;
+
+        // Scratch block of each instruction in evaluateBatch
+        std::vector<std::uint32_t> registers;
+        std::uint32_t numRegisters = 0;
+
+        // Scratch space for evaluate, sized on first use: one value per instruction and one per slot
+        mutable std::vector<double> values;
+        mutable std::vector<double> slotValues;
+        mutable std::vector<EvalErrors> slotErrors;
+
+        // Scratch space for gradient: the adjoint (d result / d value) of each instruction
+        mutable std::vector<double> adjoints;
+};
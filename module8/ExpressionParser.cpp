@@ -0,0 +1,243 @@
+#include "ExpressionParser.h"
+#include "NodeFactory.h"
+#include <charconv>
+#include <utility>
+
+static bool isIdentifierStart(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static bool isIdentifierChar(char c) {
+    return isIdentifierStart(c) || (c >= '0' && c <= '9');
+}
+
+static bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// Binding strength of each operator; higher binds tighter
+static int precedence(char op) {
+    switch (op) {
+        case '+':
+        case '-':
+            return 1;
+        case '*':
+        case '/':
+            return 2;
+        case 'n':
+            return 3;
+        default:
+            return 0;
+    }
+}
+
+// Kind of node written as a call to name; false if name is not a function
+static bool functionCode(std::string_view name, OpCode& op) {
+    static const std::pair<const char*, OpCode> functions[] = {
+        {"pow", OpCode::Pow}, {"min", OpCode::Min}, {"max", OpCode::Max}, {"exp", OpCode::Exp},
+        {"log", OpCode::Log}, {"sin", OpCode::Sin}, {"cos", OpCode::Cos}, {"sqrt", OpCode::Sqrt},
+        {"select", OpCode::Select}};
+    for (const auto& function : functions) {
+        if (name == function.first) {
+            op = function.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+PARSEERROR FUNCTIONS
+*/
+ParseError::ParseError(const std::string& message, std::size_t position)
+    : std::runtime_error(message + " at position " + std::to_string(position)), offset(position) {}
+
+/*
+EXPRESSIONPARSER FUNCTIONS
+*/
+ExpressionParser::ExpressionParser(NodeFactory* factory) : factory(factory) {}
+
+node_ptr ExpressionParser::parse(std::string_view text) {
+    operands.clear();
+    operators.clear();
+
+    // Shunting-yard: operands and operators wait on stacks until precedence says they can combine
+    bool expectOperand = true;
+    std::size_t pos = 0;
+    while (true) {
+        while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) {
+            pos++;
+        }
+        if (pos == text.size()) {
+            break;
+        }
+        char c = text[pos];
+
+        if (expectOperand) {
+            if (c == '(') {
+                operators.push_back({'(', pos});
+                pos++;
+            } else if (c == '-') {
+                operators.push_back({'n', pos});
+                pos++;
+            } else if (c == '+') {
+                pos++;
+            } else if (isDigit(c) || c == '.') {
+                double value;
+                auto parsed = std::from_chars(text.data() + pos, text.data() + text.size(), value);
+                if (parsed.ec != std::errc()) {
+                    throw ParseError("Malformed number", pos);
+                }
+                operands.push_back(constant(value));
+                pos = static_cast<std::size_t>(parsed.ptr - text.data());
+                expectOperand = false;
+            } else if (isIdentifierStart(c)) {
+                std::size_t start = pos;
+                while (pos < text.size() && isIdentifierChar(text[pos])) {
+                    pos++;
+                }
+                std::string_view name = text.substr(start, pos - start);
+                std::size_t next = pos;
+                while (next < text.size() && (text[next] == ' ' || text[next] == '\t')) {
+                    next++;
+                }
+                OpCode function;
+                if (next < text.size() && text[next] == '(' && functionCode(name, function)) {
+                    operators.push_back({'f', start, function, 1});
+                    operators.push_back({'(', next});
+                    pos = next + 1;
+                } else {
+                    operands.push_back(variable(name));
+                    expectOperand = false;
+                }
+            } else {
+                throw ParseError(std::string("Expected a number, variable or '(' but found '") + c + "'", pos);
+            }
+            continue;
+        }
+
+        if (c == '+' || c == '-' || c == '*' || c == '/') {
+            while (!operators.empty() && precedence(operators.back().op) >= precedence(c)) {
+                reduce();
+            }
+            operators.push_back({c, pos});
+            pos++;
+            expectOperand = true;
+        } else if (c == ')') {
+            while (!operators.empty() && operators.back().op != '(') {
+                reduce();
+            }
+            if (operators.empty()) {
+                throw ParseError("Unmatched ')'", pos);
+            }
+            operators.pop_back();
+            if (!operators.empty() && operators.back().op == 'f') {
+                PendingOperator function = operators.back();
+                operators.pop_back();
+                call(function);
+            }
+            pos++;
+        } else if (c == ',') {
+            while (!operators.empty() && operators.back().op != '(') {
+                reduce();
+            }
+            if (operators.size() < 2 || operators[operators.size() - 2].op != 'f') {
+                throw ParseError("',' outside a function call", pos);
+            }
+            operators[operators.size() - 2].arguments++;
+            pos++;
+            expectOperand = true;
+        } else {
+            throw ParseError(std::string("Expected an operator, ',' or ')' but found '") + c + "'", pos);
+        }
+    }
+
+    if (expectOperand) {
+        throw ParseError(text.empty() ? "Empty expression" : "Unexpected end of expression", pos);
+    }
+    while (!operators.empty()) {
+        if (operators.back().op == '(') {
+            throw ParseError("Unmatched '('", operators.back().position);
+        }
+        reduce();
+    }
+
+    node_ptr result = std::move(operands.back());
+    operands.clear();
+    return result;
+}
+
+void ExpressionParser::reduce() {
+    char op = operators.back().op;
+    operators.pop_back();
+
+    node_ptr right = std::move(operands.back());
+    operands.pop_back();
+    if (op == 'n') {
+        // A negative literal stays a single constant
+        if (right->opcode() == OpCode::Constant) {
+            operands.push_back(constant(-static_cast<const Constant&>(*right).getValue()));
+        } else if (factory) {
+            operands.push_back(factory->mul(factory->constant(-1.0), right));
+        } else {
+            operands.push_back(std::make_shared<Mul>(std::make_shared<Constant>(-1.0), right));
+        }
+        return;
+    }
+
+    node_ptr left = std::move(operands.back());
+    operands.pop_back();
+    node_ptr result;
+    switch (op) {
+        case '+':
+            result = factory ? factory->add(left, right) : std::make_shared<Add>(left, right);
+            break;
+        case '-':
+            result = factory ? factory->sub(left, right) : std::make_shared<Sub>(left, right);
+            break;
+        case '*':
+            result = factory ? factory->mul(left, right) : std::make_shared<Mul>(left, right);
+            break;
+        default:
+            result = factory ? factory->div(left, right) : std::make_shared<Div>(left, right);
+            break;
+    }
+    operands.push_back(std::move(result));
+}
+
+void ExpressionParser::call(const PendingOperator& function) {
+    std::size_t count = arity(function.function);
+    if (function.arguments != count) {
+        throw ParseError("Function expects " + std::to_string(count) + (count == 1 ? " argument" : " arguments")
+                         + ", got " + std::to_string(function.arguments), function.position);
+    }
+
+    node_ptr children[3];
+    for (std::size_t i = count; i-- > 0;) {
+        children[i] = std::move(operands.back());
+        operands.pop_back();
+    }
+    operands.push_back(factory ? factory->make(function.function, children) : makeNode(function.function, children));
+}
+
+node_ptr ExpressionParser::variable(std::string_view name) {
+    auto itr = variables.find(name);
+    if (itr != variables.end()) {
+        return itr->second;
+    }
+
+    // First sighting of this name: the only string allocation it will ever cost
+    node_ptr node = factory ? factory->variable(std::string(name)) : std::make_shared<Variable>(std::string(name));
+    std::string_view key = static_cast<const Variable&>(*node).getName();
+    variables.emplace(key, node);
+    return node;
+}
+
+node_ptr ExpressionParser::constant(double value) {
+    return factory ? factory->constant(value) : std::make_shared<Constant>(value);
+}
+
+node_ptr parseExpression(std::string_view text) {
+    ExpressionParser parser;
+    return parser.parse(text);
+}
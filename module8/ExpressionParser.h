@@ -0,0 +1,68 @@
+#pragma once
+#include "ExpressionTree.h"
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class NodeFactory;
+
+// Thrown for malformed input; position is the offset in the text of the offending character
+class ParseError : public std::runtime_error {
+    public:
+        ParseError(const std::string& message, std::size_t position);
+        std::size_t position() const { return offset; }
+    private:
+        std::size_t offset;
+};
+
+// Parses infix text such as "(2 + x) * y / Zebra" into a node_ptr tree. * and / bind tighter
+// than + and -, all four are left-associative, and unary minus is allowed ("-x" becomes -1 * x).
+// Functions are written as calls: pow(x, y), min(x, y), max(x, y), exp(x), log(x), sin(x),
+// cos(x), sqrt(x) and select(condition, ifTrue, ifFalse). A function name not followed by '('
+// is an ordinary variable.
+//
+// Built for bulk input: tokens are read in place from the string_view, numbers are converted
+// with std::from_chars, the parser's stacks are reused between calls, and each variable name
+// gets one Variable node that every later expression shares, so parsing allocates only the
+// nodes it returns. The walk uses explicit stacks, so deeply nested input cannot overflow the
+// call stack. One parser must not be used from several threads at once.
+class ExpressionParser {
+    public:
+        // With a factory, nodes are built (and simplified) through it and come out interned
+        explicit ExpressionParser(NodeFactory* factory = nullptr);
+
+        // Throws ParseError for malformed text
+        node_ptr parse(std::string_view text);
+
+    private:
+        // Operator waiting on the stack: '+', '-', '*', '/', 'n' (unary minus), '(' or 'f' (a
+        // function call, below the '(' of its arguments)
+        struct PendingOperator {
+            char op;
+            std::size_t position;
+            OpCode function = OpCode::Constant;
+            std::size_t arguments = 0;
+        };
+
+        node_ptr variable(std::string_view name);
+        node_ptr constant(double value);
+
+        // Pop the top operator and its operands, pushing the node they make
+        void reduce();
+
+        // Pop the arguments of a function call whose ')' was reached, pushing the call
+        void call(const PendingOperator& function);
+
+        NodeFactory* factory;
+        std::vector<node_ptr> operands;
+        std::vector<PendingOperator> operators;
+
+        // Keys view the names held by the Variable nodes themselves
+        std::unordered_map<std::string_view, node_ptr> variables;
+};
+
+// Parse one expression with a temporary parser
+node_ptr parseExpression(std::string_view text);
@@ -1,27 +1,247 @@
 #include "ExpressionTree.h"
-#include <sstream>
+#include "Simplifier.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <streambuf>
+#include <string_view>
+#include <vector>
+
+double evaluationError(EvalErrors* errors, EvalErrors error, const std::string& message) {
+    if (!errors) {
+        throw std::runtime_error(message);
+    }
+    *errors |= error;
+    return std::numeric_limits<double>::quiet_NaN();
+}
+
+// Operator written between the operands, or nullptr for nodes written as function calls
+static const char* infixSymbol(OpCode op) {
+    switch (op) {
+        case OpCode::Add:
+            return " + ";
+        case OpCode::Sub:
+            return " - ";
+        case OpCode::Mul:
+            return " * ";
+        case OpCode::Div:
+            return " / ";
+        default:
+            return nullptr;
+    }
+}
+
+// Name of the nodes written as function calls
+static const char* functionName(OpCode op) {
+    switch (op) {
+        case OpCode::Pow:
+            return "pow";
+        case OpCode::Min:
+            return "min";
+        case OpCode::Max:
+            return "max";
+        case OpCode::Exp:
+            return "exp";
+        case OpCode::Log:
+            return "log";
+        case OpCode::Sin:
+            return "sin";
+        case OpCode::Cos:
+            return "cos";
+        case OpCode::Sqrt:
+            return "sqrt";
+        default:
+            return "select";
+    }
+}
+
+// Whether a derivative came out as the constant 0, so terms it scales can be left out
+static bool isZero(const node_ptr& node) {
+    return node->opcode() == OpCode::Constant && static_cast<const Constant&>(*node).getValue() == 0.0;
+}
+
+/*
+NODE FUNCTIONS
+*/
+std::string Node::toString() const {
+    std::string text;
+    appendTo(text);
+    return text;
+}
+
+// Write the string representation of root through out.append(text, length). The tree is
+// walked iteratively, so deep trees cannot overflow the stack
+template <typename Output>
+static void writeExpression(const Node& root, Output& out) {
+    auto write = [&out](std::string_view text) { out.append(text.data(), text.size()); };
+
+    // Work still to do, last first: a node to write, or (node == nullptr) a piece of text
+    struct Piece {
+        const Node* node;
+        const char* text;
+    };
+    std::vector<Piece> pending{{&root, nullptr}};
+    while (!pending.empty()) {
+        Piece piece = pending.back();
+        pending.pop_back();
+        if (!piece.node) {
+            write(piece.text);
+            continue;
+        }
+
+        switch (piece.node->opcode()) {
+            case OpCode::Constant: {
+                // Same digits as writing the double to an ostream (%g, 6 significant digits)
+                char buffer[32];
+                double value = static_cast<const Constant*>(piece.node)->getValue();
+                auto written = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::general, 6);
+                out.append(buffer, static_cast<std::size_t>(written.ptr - buffer));
+                break;
+            }
+            case OpCode::Variable:
+                write(static_cast<const Variable*>(piece.node)->getName());
+                break;
+            default: {
+                const Node* node = piece.node;
+                std::size_t count = arity(node->opcode());
+                const char* symbol = infixSymbol(node->opcode());
+                if (symbol) {
+                    write("(");
+                    pending.push_back({nullptr, ")"});
+                    pending.push_back({node->child(1).get(), nullptr});
+                    pending.push_back({nullptr, symbol});
+                    pending.push_back({node->child(0).get(), nullptr});
+                    break;
+                }
+                write(functionName(node->opcode()));
+                write("(");
+                pending.push_back({nullptr, ")"});
+                for (std::size_t i = count; i-- > 0;) {
+                    pending.push_back({node->child(i).get(), nullptr});
+                    if (i > 0) {
+                        pending.push_back({nullptr, ", "});
+                    }
+                }
+                break;
+            }
+        }
+    }
+}
+
+void Node::appendTo(std::string& out) const {
+    writeExpression(*this, out);
+}
+
+// Output for writeExpression that goes to a stream's buffer in chunks of a small fixed array,
+// so printing a tree needs neither a temporary string nor a virtual call per piece
+class StreamBufferOutput {
+    public:
+        explicit StreamBufferOutput(std::streambuf* buffer) : buffer(buffer) {}
+
+        void append(const char* text, std::size_t length) {
+            if (used + length > sizeof(chunk)) {
+                flush();
+                if (length > sizeof(chunk)) {
+                    write(text, length);
+                    return;
+                }
+            }
+            std::copy(text, text + length, chunk + used);
+            used += length;
+        }
+
+        // Write what is left in the chunk, returning false if anything could not be written
+        bool flush() {
+            write(chunk, used);
+            used = 0;
+            return !failed;
+        }
+
+    private:
+        void write(const char* text, std::size_t length) {
+            std::streamsize count = static_cast<std::streamsize>(length);
+            failed = failed || buffer->sputn(text, count) != count;
+        }
+
+        std::streambuf* buffer;
+        char chunk[1024];
+        std::size_t used = 0;
+        bool failed = false;
+};
 
 // To be used with output
 std::ostream& operator<<(std::ostream& os, const node_ptr& node) {
+    std::ostream::sentry ready(os);
+    if (!ready) {
+        return os;
+    }
+    StreamBufferOutput out(os.rdbuf());
     if (!node) {
-        os << "(null)";
+        out.append("(null)", 6);
     } else {
-        os << node->toString();
+        writeExpression(*node, out);
+    }
+    if (!out.flush()) {
+        os.setstate(std::ios::badbit);
     }
     return os;
 }
 
+const node_ptr& Node::child(std::size_t index) const {
+    throw std::out_of_range("Node has no child " + std::to_string(index));
+}
+
+node_ptr makeNode(OpCode op, const node_ptr* children) {
+    switch (op) {
+        case OpCode::Add:
+            return std::make_shared<Add>(children[0], children[1]);
+        case OpCode::Sub:
+            return std::make_shared<Sub>(children[0], children[1]);
+        case OpCode::Mul:
+            return std::make_shared<Mul>(children[0], children[1]);
+        case OpCode::Div:
+            return std::make_shared<Div>(children[0], children[1]);
+        case OpCode::Pow:
+            return std::make_shared<Pow>(children[0], children[1]);
+        case OpCode::Min:
+            return std::make_shared<Min>(children[0], children[1]);
+        case OpCode::Max:
+            return std::make_shared<Max>(children[0], children[1]);
+        case OpCode::Exp:
+            return std::make_shared<Exp>(children[0]);
+        case OpCode::Log:
+            return std::make_shared<Log>(children[0]);
+        case OpCode::Sin:
+            return std::make_shared<Sin>(children[0]);
+        case OpCode::Cos:
+            return std::make_shared<Cos>(children[0]);
+        case OpCode::Sqrt:
+            return std::make_shared<Sqrt>(children[0]);
+        case OpCode::Select:
+            return std::make_shared<Select>(children[0], children[1], children[2]);
+        default:
+            throw std::invalid_argument("Constants and variables are not built from children");
+    }
+}
+
 /*
-CONSTANT FUNCTIONS
+BINARYOP FUNCTIONS
 */
-double Constant::evaluate(const SymbolTable& symbols) const {
-    return value;
+const node_ptr& BinaryOp::child(std::size_t index) const {
+    if (index >= 2) {
+        return Node::child(index);
+    }
+    return index == 0 ? left : right;
 }
 
-std::string Constant::toString() const {
-    std::ostringstream ss;
-    ss << value;
-    return ss.str();
+/*
+CONSTANT FUNCTIONS
+*/
+double Constant::compute(const SymbolTable&, EvalErrors*) const {
+    return value;
 }
 
 node_ptr Constant::derivative(const std::string& var) const {
@@ -32,21 +252,17 @@ node_ptr Constant::derivative(const std::string& var) const {
 /*
 VARIABLE FUNCTIONS
 */
-double Variable::evaluate(const SymbolTable& symbols) const {
+double Variable::compute(const SymbolTable& symbols, EvalErrors* errors) const {
     // Find variable iterator in symbol table
     auto itr = symbols.find(name);
 
     // Check if symbol is not found
     if (itr == symbols.end()) {
-        throw std::runtime_error("Variable value not found for: " + name);
+        return evaluationError(errors, EVAL_MISSING_VARIABLE, "Variable value not found for: " + name);
     }
     return itr->second;
 }
 
-std::string Variable::toString() const {
-    return name;
-}
-
 node_ptr Variable::derivative(const std::string& var) const {
     // d/dx(x) = 1, d/dx(y) = 0
     if (name == var) {
@@ -60,17 +276,13 @@ ADDITION FUNCTIONS
 */
 Add::Add(node_ptr left, node_ptr right) : BinaryOp(left, right) {}
 
-double Add::evaluate(const SymbolTable& symbols) const {
-    return left->evaluate(symbols) + right->evaluate(symbols);
-}
-
-std::string Add::toString() const {
-    return "(" + left->toString() + " + " + right->toString() + ")";
+double Add::compute(const SymbolTable& symbols, EvalErrors* errors) const {
+    return left->compute(symbols, errors) + right->compute(symbols, errors);
 }
 
 node_ptr Add::derivative(const std::string& var) const {
     // d(u+v) = du + dv
-    return std::make_shared<Add>(
+    return makeAdd(
         left->derivative(var), 
         right->derivative(var)
     );
@@ -81,17 +293,13 @@ SUBSTITUTION FUNCTIONS
 */
 Sub::Sub(node_ptr left, node_ptr right) : BinaryOp(left, right) {}
 
-double Sub::evaluate(const SymbolTable& symbols) const {
-    return left->evaluate(symbols) - right->evaluate(symbols);
-}
-
-std::string Sub::toString() const {
-    return "(" + left->toString() + " - " + right->toString() + ")";
+double Sub::compute(const SymbolTable& symbols, EvalErrors* errors) const {
+    return left->compute(symbols, errors) - right->compute(symbols, errors);
 }
 
 node_ptr Sub::derivative(const std::string& var) const {
     // d(u-v) = du - dv
-    return std::make_shared<Sub>(
+    return makeSub(
         left->derivative(var), 
         right->derivative(var)
     );
@@ -102,12 +310,8 @@ MULTIPLICATION FUNCTIONS
 */
 Mul::Mul(node_ptr left, node_ptr right) : BinaryOp(left, right) {}
 
-double Mul::evaluate(const SymbolTable& symbols) const {
-    return left->evaluate(symbols) * right->evaluate(symbols);
-}
-
-std::string Mul::toString() const {
-    return "(" + left->toString() + " * " + right->toString() + ")";
+double Mul::compute(const SymbolTable& symbols, EvalErrors* errors) const {
+    return left->compute(symbols, errors) * right->compute(symbols, errors);
 }
 
 node_ptr Mul::derivative(const std::string& var) const {
@@ -116,9 +320,9 @@ node_ptr Mul::derivative(const std::string& var) const {
     node_ptr dv = right->derivative(var);
 
     // Sum left and right sides
-    return std::make_shared<Add>(
-        std::make_shared<Mul>(left, dv), 
-        std::make_shared<Mul>(right, du)
+    return makeAdd(
+        makeMul(left, dv), 
+        makeMul(right, du)
     );
 }
 
@@ -127,15 +331,13 @@ DIVISION FUNCTIONS
 */
 Div::Div(node_ptr left, node_ptr right) : BinaryOp(left, right) {}
 
-double Div::evaluate(const SymbolTable& symbols) const {
-    if (right->evaluate(symbols) == 0.0) {
-        throw std::runtime_error("Cannot divide by 0!");
+double Div::compute(const SymbolTable& symbols, EvalErrors* errors) const {
+    double numerator = left->compute(symbols, errors);
+    double denominator = right->compute(symbols, errors);
+    if (denominator == 0.0) {
+        return evaluationError(errors, EVAL_DIVIDE_BY_ZERO, "Cannot divide by 0!");
     }
-    return left->evaluate(symbols) / right->evaluate(symbols);
-}
-
-std::string Div::toString() const {
-    return "(" + left->toString() + " / " + right->toString() + ")";
+    return numerator / denominator;
 }
 
 node_ptr Div::derivative(const std::string& var) const {
@@ -144,13 +346,190 @@ node_ptr Div::derivative(const std::string& var) const {
     node_ptr dv = right->derivative(var);
 
     // v*du - u*dv -> v*du - u*dv
-    node_ptr leftTerm = std::make_shared<Sub>(
-        std::make_shared<Mul>(right, du), 
-        std::make_shared<Mul>(left, dv));
+    node_ptr leftTerm = makeSub(
+        makeMul(right, du), 
+        makeMul(left, dv));
 
     // v * v
-    node_ptr rightTerm = std::make_shared<Mul>(right, right);
+    node_ptr rightTerm = makeMul(right, right);
 
     // Divide left by right side
-    return std::make_shared<Div>(leftTerm, rightTerm);
-}
\ No newline at end of file
+    return makeDiv(leftTerm, rightTerm);
+}
+
+/*
+POWER FUNCTIONS
+*/
+Pow::Pow(node_ptr left, node_ptr right) : BinaryOp(left, right) {}
+
+double Pow::compute(const SymbolTable& symbols, EvalErrors* errors) const {
+    return std::pow(left->compute(symbols, errors), right->compute(symbols, errors));
+}
+
+node_ptr Pow::derivative(const std::string& var) const {
+    node_ptr du = left->derivative(var);
+    node_ptr dv = right->derivative(var);
+
+    // d(u^c) = c * u^(c-1) * du, which also holds for a negative u
+    if (isZero(dv)) {
+        return makeMul(
+            makeMul(right, makePow(left, makeSub(right, std::make_shared<Constant>(1.0)))),
+            du);
+    }
+
+    // d(u^v) = u^v * (dv * log(u) + v * du / u)
+    node_ptr rate = makeMul(dv, makeLog(left));
+    if (!isZero(du)) {
+        rate = makeAdd(rate, makeDiv(makeMul(right, du), left));
+    }
+    return makeMul(makePow(left, right), rate);
+}
+
+/*
+MINIMUM FUNCTIONS
+*/
+Min::Min(node_ptr left, node_ptr right) : BinaryOp(left, right) {}
+
+double Min::compute(const SymbolTable& symbols, EvalErrors* errors) const {
+    return std::min(left->compute(symbols, errors), right->compute(symbols, errors));
+}
+
+node_ptr Min::derivative(const std::string& var) const {
+    // The derivative of whichever side is chosen: right where right < left
+    return makeSelect(makeSub(left, right), right->derivative(var), left->derivative(var));
+}
+
+/*
+MAXIMUM FUNCTIONS
+*/
+Max::Max(node_ptr left, node_ptr right) : BinaryOp(left, right) {}
+
+double Max::compute(const SymbolTable& symbols, EvalErrors* errors) const {
+    return std::max(left->compute(symbols, errors), right->compute(symbols, errors));
+}
+
+node_ptr Max::derivative(const std::string& var) const {
+    // The derivative of whichever side is chosen: right where left < right
+    return makeSelect(makeSub(right, left), right->derivative(var), left->derivative(var));
+}
+
+/*
+UNARYOP FUNCTIONS
+*/
+const node_ptr& UnaryOp::child(std::size_t index) const {
+    if (index >= 1) {
+        return Node::child(index);
+    }
+    return operand;
+}
+
+/*
+EXPONENTIAL FUNCTIONS
+*/
+Exp::Exp(node_ptr operand) : UnaryOp(operand) {}
+
+double Exp::compute(const SymbolTable& symbols, EvalErrors* errors) const {
+    return std::exp(operand->compute(symbols, errors));
+}
+
+node_ptr Exp::derivative(const std::string& var) const {
+    // d(e^u) = e^u * du
+    return makeMul(operand->derivative(var), makeExp(operand));
+}
+
+/*
+LOGARITHM FUNCTIONS
+*/
+Log::Log(node_ptr operand) : UnaryOp(operand) {}
+
+double Log::compute(const SymbolTable& symbols, EvalErrors* errors) const {
+    return std::log(operand->compute(symbols, errors));
+}
+
+node_ptr Log::derivative(const std::string& var) const {
+    // d(log u) = du / u
+    node_ptr du = operand->derivative(var);
+    if (isZero(du)) {
+        return du;
+    }
+    return makeDiv(du, operand);
+}
+
+/*
+SINE FUNCTIONS
+*/
+Sin::Sin(node_ptr operand) : UnaryOp(operand) {}
+
+double Sin::compute(const SymbolTable& symbols, EvalErrors* errors) const {
+    return std::sin(operand->compute(symbols, errors));
+}
+
+node_ptr Sin::derivative(const std::string& var) const {
+    // d(sin u) = cos u * du
+    return makeMul(operand->derivative(var), makeCos(operand));
+}
+
+/*
+COSINE FUNCTIONS
+*/
+Cos::Cos(node_ptr operand) : UnaryOp(operand) {}
+
+double Cos::compute(const SymbolTable& symbols, EvalErrors* errors) const {
+    return std::cos(operand->compute(symbols, errors));
+}
+
+node_ptr Cos::derivative(const std::string& var) const {
+    // d(cos u) = -sin u * du
+    return makeMul(
+        std::make_shared<Constant>(-1.0),
+        makeMul(operand->derivative(var), makeSin(operand)));
+}
+
+/*
+SQUARE ROOT FUNCTIONS
+*/
+Sqrt::Sqrt(node_ptr operand) : UnaryOp(operand) {}
+
+double Sqrt::compute(const SymbolTable& symbols, EvalErrors* errors) const {
+    return std::sqrt(operand->compute(symbols, errors));
+}
+
+node_ptr Sqrt::derivative(const std::string& var) const {
+    // d(sqrt u) = du / (2 * sqrt u)
+    node_ptr du = operand->derivative(var);
+    if (isZero(du)) {
+        return du;
+    }
+    return makeDiv(du, makeMul(std::make_shared<Constant>(2.0), makeSqrt(operand)));
+}
+
+/*
+SELECT FUNCTIONS
+*/
+Select::Select(node_ptr condition, node_ptr ifTrue, node_ptr ifFalse)
+    : condition(std::move(condition)), ifTrue(std::move(ifTrue)), ifFalse(std::move(ifFalse)) {}
+
+double Select::compute(const SymbolTable& symbols, EvalErrors* errors) const {
+    if (condition->compute(symbols, errors) > 0.0) {
+        return ifTrue->compute(symbols, errors);
+    }
+    return ifFalse->compute(symbols, errors);
+}
+
+node_ptr Select::derivative(const std::string& var) const {
+    // The condition only picks a branch, so it has no derivative of its own
+    return makeSelect(condition, ifTrue->derivative(var), ifFalse->derivative(var));
+}
+
+const node_ptr& Select::child(std::size_t index) const {
+    switch (index) {
+        case 0:
+            return condition;
+        case 1:
+            return ifTrue;
+        case 2:
+            return ifFalse;
+        default:
+            return Node::child(index);
+    }
+}
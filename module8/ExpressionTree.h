@@ -1,6 +1,10 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <map>
+#include <string>
+#include <utility>
 
 // Forward declaration of Node class
 class Node;
@@ -11,6 +15,53 @@ using node_ptr = std::shared_ptr<Node>;
 // Symbol table for variables
 using SymbolTable = std::map<std::string, double>;
 
+// Kind of each node, so passes over a tree (such as compiling it to a tape) can switch on it
+enum class OpCode : std::uint8_t {
+    Constant,
+    Variable,
+    Add,
+    Sub,
+    Mul,
+    Div,
+    Pow,
+    Min,
+    Max,
+    Exp,
+    Log,
+    Sin,
+    Cos,
+    Sqrt,
+    Select
+};
+
+// Number of children of a node of each kind
+inline std::size_t arity(OpCode op) {
+    switch (op) {
+        case OpCode::Constant:
+        case OpCode::Variable:
+            return 0;
+        case OpCode::Exp:
+        case OpCode::Log:
+        case OpCode::Sin:
+        case OpCode::Cos:
+        case OpCode::Sqrt:
+            return 1;
+        case OpCode::Select:
+            return 3;
+        default:
+            return 2;
+    }
+}
+
+// Errors an evaluation can report instead of throwing, as bits of an EvalErrors mask
+using EvalErrors = std::uint8_t;
+const EvalErrors EVAL_DIVIDE_BY_ZERO = 1;
+const EvalErrors EVAL_MISSING_VARIABLE = 2;
+
+// Report an evaluation error: throws std::runtime_error(message) if errors is null, else adds
+// error to *errors and returns NaN as the value of the failed operation
+double evaluationError(EvalErrors* errors, EvalErrors error, const std::string& message);
+
 // Non-member operator << for expression tree nodes
 std::ostream& operator<<(std::ostream& os, const node_ptr& node);
 
@@ -20,23 +71,46 @@ class Node {
         // Virtual destructor
         virtual ~Node() = default;
 
-        // Evaluate an expression tree with a symbol table
-        virtual double evaluate(const SymbolTable& symbols) const = 0;
+        // Evaluate an expression tree with a symbol table; throws std::runtime_error on a
+        // division by zero or a variable missing from symbols
+        double evaluate(const SymbolTable& symbols) const { return compute(symbols, nullptr); }
+
+        // Evaluate without throwing: a failed operation gives NaN and adds its error to errors
+        // (which is not cleared first), and evaluation goes on
+        double tryEvaluate(const SymbolTable& symbols, EvalErrors& errors) const { return compute(symbols, &errors); }
+
+        // Evaluation proper, each child exactly once; errors as in evaluationError
+        virtual double compute(const SymbolTable& symbols, EvalErrors* errors) const = 0;
 
-        // Return string representation
-        virtual std::string toString() const = 0;
+        // Return string representation, e.g. "((2.3 * Xray) + Yellow)"
+        std::string toString() const;
 
-        // Create the derivative (new expression tree) with respect to a variable
+        // Append the string representation to out. The tree is walked iteratively, so deep
+        // trees cannot overflow the stack, and reusing out between calls avoids allocating
+        void appendTo(std::string& out) const;
+
+        // Create the derivative (new expression tree, simplified as it is built) with respect to a variable
         virtual node_ptr derivative(const std::string& var) const = 0;
+
+        // Kind of node
+        virtual OpCode opcode() const = 0;
+
+        // Child number index, for index < arity(opcode()); throws std::out_of_range otherwise
+        virtual const node_ptr& child(std::size_t index) const;
 };
 
+// Node of the given kind over arity(op) children, built as is (not simplified). Throws
+// std::invalid_argument for Constant and Variable, which have no children
+node_ptr makeNode(OpCode op, const node_ptr* children);
+
 // Declare Constant as a subclass of Node
 class Constant : public Node {
     public:
         explicit Constant(double v) : value(v) {}
-        double evaluate(const SymbolTable& symbols) const override;
-        std::string toString() const override;
+        double compute(const SymbolTable& symbols, EvalErrors* errors) const override;
         node_ptr derivative(const std::string& var) const override;
+        OpCode opcode() const override { return OpCode::Constant; }
+        double getValue() const { return value; }
     private:
         double value;
 };
@@ -45,9 +119,10 @@ class Constant : public Node {
 class Variable : public Node {
     public:
         explicit Variable(const std::string& n) : name(n) {}
-        double evaluate(const SymbolTable& symbols) const override;
-        std::string toString() const override;
+        double compute(const SymbolTable& symbols, EvalErrors* errors) const override;
         node_ptr derivative(const std::string& var) const override;
+        OpCode opcode() const override { return OpCode::Variable; }
+        const std::string& getName() const { return name; }
     private:
         std::string name;
 };
@@ -56,6 +131,9 @@ class Variable : public Node {
 class BinaryOp : public Node {
     public:
         BinaryOp(node_ptr l, node_ptr r) : left(std::move(l)), right(std::move(r)) {}
+        const node_ptr& getLeft() const { return left; }
+        const node_ptr& getRight() const { return right; }
+        const node_ptr& child(std::size_t index) const override;
 
     protected:
         node_ptr left;
@@ -66,34 +144,138 @@ class BinaryOp : public Node {
 class Add : public BinaryOp {
     public:
         Add(node_ptr left, node_ptr right);
-        double evaluate(const SymbolTable& symbols) const override;
-        std::string toString() const override;
+        double compute(const SymbolTable& symbols, EvalErrors* errors) const override;
         node_ptr derivative(const std::string& var) const override;
+        OpCode opcode() const override { return OpCode::Add; }
 };
 
 // Subtraction of nodes
 class Sub : public BinaryOp {
     public:
         Sub(node_ptr left, node_ptr right);
-        double evaluate(const SymbolTable& symbols) const override;
-        std::string toString() const override;
+        double compute(const SymbolTable& symbols, EvalErrors* errors) const override;
         node_ptr derivative(const std::string& var) const override;
+        OpCode opcode() const override { return OpCode::Sub; }
 };
 
 // Multiplication of nodes
 class Mul : public BinaryOp {
     public:
         Mul(node_ptr left, node_ptr right);
-        double evaluate(const SymbolTable& symbols) const override;
-        std::string toString() const override;
+        double compute(const SymbolTable& symbols, EvalErrors* errors) const override;
         node_ptr derivative(const std::string& var) const override;
+        OpCode opcode() const override { return OpCode::Mul; }
 };
 
 // Division of nodes
 class Div : public BinaryOp {
     public:
         Div(node_ptr left, node_ptr right);
-        double evaluate(const SymbolTable& symbols) const override;
-        std::string toString() const override;
+        double compute(const SymbolTable& symbols, EvalErrors* errors) const override;
+        node_ptr derivative(const std::string& var) const override;
+        OpCode opcode() const override { return OpCode::Div; }
+};
+
+// Power: left raised to right, as std::pow
+class Pow : public BinaryOp {
+    public:
+        Pow(node_ptr left, node_ptr right);
+        double compute(const SymbolTable& symbols, EvalErrors* errors) const override;
+        node_ptr derivative(const std::string& var) const override;
+        OpCode opcode() const override { return OpCode::Pow; }
+};
+
+// Smaller of two nodes, as std::min (left when they are equal)
+class Min : public BinaryOp {
+    public:
+        Min(node_ptr left, node_ptr right);
+        double compute(const SymbolTable& symbols, EvalErrors* errors) const override;
+        node_ptr derivative(const std::string& var) const override;
+        OpCode opcode() const override { return OpCode::Min; }
+};
+
+// Larger of two nodes, as std::max (left when they are equal)
+class Max : public BinaryOp {
+    public:
+        Max(node_ptr left, node_ptr right);
+        double compute(const SymbolTable& symbols, EvalErrors* errors) const override;
+        node_ptr derivative(const std::string& var) const override;
+        OpCode opcode() const override { return OpCode::Max; }
+};
+
+// Function of one node. Functions follow <cmath> outside their domain (log of a negative is
+// NaN, log(0) is -inf) rather than throwing
+class UnaryOp : public Node {
+    public:
+        explicit UnaryOp(node_ptr o) : operand(std::move(o)) {}
+        const node_ptr& getOperand() const { return operand; }
+        const node_ptr& child(std::size_t index) const override;
+
+    protected:
+        node_ptr operand;
+};
+
+// e raised to a node
+class Exp : public UnaryOp {
+    public:
+        explicit Exp(node_ptr operand);
+        double compute(const SymbolTable& symbols, EvalErrors* errors) const override;
+        node_ptr derivative(const std::string& var) const override;
+        OpCode opcode() const override { return OpCode::Exp; }
+};
+
+// Natural logarithm of a node
+class Log : public UnaryOp {
+    public:
+        explicit Log(node_ptr operand);
+        double compute(const SymbolTable& symbols, EvalErrors* errors) const override;
         node_ptr derivative(const std::string& var) const override;
+        OpCode opcode() const override { return OpCode::Log; }
+};
+
+// Sine of a node (radians)
+class Sin : public UnaryOp {
+    public:
+        explicit Sin(node_ptr operand);
+        double compute(const SymbolTable& symbols, EvalErrors* errors) const override;
+        node_ptr derivative(const std::string& var) const override;
+        OpCode opcode() const override { return OpCode::Sin; }
+};
+
+// Cosine of a node (radians)
+class Cos : public UnaryOp {
+    public:
+        explicit Cos(node_ptr operand);
+        double compute(const SymbolTable& symbols, EvalErrors* errors) const override;
+        node_ptr derivative(const std::string& var) const override;
+        OpCode opcode() const override { return OpCode::Cos; }
+};
+
+// Square root of a node
+class Sqrt : public UnaryOp {
+    public:
+        explicit Sqrt(node_ptr operand);
+        double compute(const SymbolTable& symbols, EvalErrors* errors) const override;
+        node_ptr derivative(const std::string& var) const override;
+        OpCode opcode() const override { return OpCode::Sqrt; }
+};
+
+// Conditional: ifTrue where condition > 0, else ifFalse. Only the chosen branch counts, so an
+// error in the other (select(x, 1 / x, 0) at x = 0) is not reported. The tree evaluates just
+// the chosen branch; tapes compute both and discard the error with the value
+class Select : public Node {
+    public:
+        Select(node_ptr condition, node_ptr ifTrue, node_ptr ifFalse);
+        double compute(const SymbolTable& symbols, EvalErrors* errors) const override;
+        node_ptr derivative(const std::string& var) const override;
+        OpCode opcode() const override { return OpCode::Select; }
+        const node_ptr& child(std::size_t index) const override;
+        const node_ptr& getCondition() const { return condition; }
+        const node_ptr& getIfTrue() const { return ifTrue; }
+        const node_ptr& getIfFalse() const { return ifFalse; }
+
+    private:
+        node_ptr condition;
+        node_ptr ifTrue;
+        node_ptr ifFalse;
 };
@@ -0,0 +1,190 @@
+#include "IncrementalEvaluator.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+// Same bits, so a change between 0.0 and -0.0 is still passed on to the users
+static bool sameValue(double a, double b) {
+    return std::memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+// Whether operand k of step is not also an earlier operand, so each user is listed once
+static bool firstUse(const Instruction& step, std::size_t k) {
+    for (std::size_t j = 0; j < k; j++) {
+        if (step.operand(j) == step.operand(k)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+INCREMENTALEVALUATOR FUNCTIONS
+*/
+IncrementalEvaluator::IncrementalEvaluator(const CompiledExpression& expression, const double* slots)
+    : expression(expression), slotValues(slots, slots + expression.numSlots()),
+      values(expression.size(), 0.0), faults(expression.size(), 0), queued(expression.size(), false) {
+    const Instruction* code = expression.code();
+    std::size_t codeSize = expression.size();
+
+    // Count users and readers, turn the counts into start offsets, then fill the lists
+    userStart.assign(codeSize + 1, 0);
+    slotStart.assign(expression.numSlots() + 1, 0);
+    for (std::size_t i = 0; i < codeSize; i++) {
+        const Instruction& step = code[i];
+        if (step.op == OpCode::Variable) {
+            slotStart[step.left + 1]++;
+        }
+        for (std::size_t k = 0; k < arity(step.op); k++) {
+            if (firstUse(step, k)) {
+                userStart[step.operand(k) + 1]++;
+            }
+        }
+    }
+    for (std::size_t i = 0; i < codeSize; i++) {
+        userStart[i + 1] += userStart[i];
+    }
+    for (std::size_t i = 0; i < expression.numSlots(); i++) {
+        slotStart[i + 1] += slotStart[i];
+    }
+
+    users.resize(userStart[codeSize]);
+    slotReaders.resize(slotStart[expression.numSlots()]);
+    std::vector<std::uint32_t> userFill(userStart.begin(), userStart.end() - 1);
+    std::vector<std::uint32_t> slotFill(slotStart.begin(), slotStart.end() - 1);
+    for (std::size_t i = 0; i < codeSize; i++) {
+        const Instruction& step = code[i];
+        std::uint32_t index = static_cast<std::uint32_t>(i);
+        if (step.op == OpCode::Variable) {
+            slotReaders[slotFill[step.left]++] = index;
+        }
+        for (std::size_t k = 0; k < arity(step.op); k++) {
+            if (firstUse(step, k)) {
+                users[userFill[step.operand(k)]++] = index;
+            }
+        }
+    }
+
+    recomputeAll();
+    evaluate();
+}
+
+IncrementalEvaluator::IncrementalEvaluator(const CompiledExpression& expression, const SymbolTable& symbols)
+    : IncrementalEvaluator(expression, expression.bind(symbols).data()) {}
+
+void IncrementalEvaluator::set(std::size_t slot, double value) {
+    if (slot >= slotValues.size()) {
+        throw std::out_of_range("No slot " + std::to_string(slot) + " in an expression with "
+                                + std::to_string(slotValues.size()) + " slots");
+    }
+    if (sameValue(slotValues[slot], value)) {
+        return;
+    }
+    slotValues[slot] = value;
+    for (std::uint32_t k = slotStart[slot]; k < slotStart[slot + 1]; k++) {
+        std::uint32_t reader = slotReaders[k];
+        if (!queued[reader]) {
+            queued[reader] = true;
+            dirty.push(reader);
+        }
+    }
+}
+
+void IncrementalEvaluator::set(const std::string& name, double value) {
+    const std::vector<std::string>& names = expression.variables();
+    for (std::size_t slot = 0; slot < names.size(); slot++) {
+        if (names[slot] == name) {
+            set(slot, value);
+            return;
+        }
+    }
+    throw std::invalid_argument("Variable has no slot: " + name);
+}
+
+double IncrementalEvaluator::evaluate() {
+    // Operands come before their users on the tape, so taking the smallest dirty index first
+    // recomputes each instruction once, after everything it reads is up to date
+    lastRecomputed = 0;
+    while (!dirty.empty()) {
+        std::uint32_t i = dirty.top();
+        EvalErrors fault = 0;
+        double value = compute(i, fault);
+        dirty.pop();
+        queued[i] = false;
+        lastRecomputed++;
+        if (sameValue(value, values[i]) && fault == faults[i]) {
+            continue;
+        }
+        values[i] = value;
+        faults[i] = fault;
+        for (std::uint32_t k = userStart[i]; k < userStart[i + 1]; k++) {
+            std::uint32_t user = users[k];
+            if (!queued[user]) {
+                queued[user] = true;
+                dirty.push(user);
+            }
+        }
+    }
+    if (faults.back() != 0) {
+        evaluationError(nullptr, faults.back(), "Cannot divide by 0!");
+    }
+    return values.back();
+}
+
+double IncrementalEvaluator::compute(std::size_t i, EvalErrors& fault) const {
+    const Instruction& step = expression.code()[i];
+    if (step.op == OpCode::Select) {
+        std::uint32_t chosen = values[step.left] > 0.0 ? step.right : step.third;
+        fault = faults[step.left] | faults[chosen];
+        return values[chosen];
+    }
+    for (std::size_t k = 0; k < arity(step.op); k++) {
+        fault |= faults[step.operand(k)];
+    }
+    switch (step.op) {
+        case OpCode::Constant:
+            return expression.constantPool()[step.left];
+        case OpCode::Variable:
+            return slotValues[step.left];
+        case OpCode::Add:
+            return values[step.left] + values[step.right];
+        case OpCode::Sub:
+            return values[step.left] - values[step.right];
+        case OpCode::Mul:
+            return values[step.left] * values[step.right];
+        case OpCode::Div:
+            if (values[step.right] == 0.0) {
+                fault |= EVAL_DIVIDE_BY_ZERO;
+                return std::numeric_limits<double>::quiet_NaN();
+            }
+            return values[step.left] / values[step.right];
+        case OpCode::Pow:
+            return std::pow(values[step.left], values[step.right]);
+        case OpCode::Min:
+            return std::min(values[step.left], values[step.right]);
+        case OpCode::Max:
+            return std::max(values[step.left], values[step.right]);
+        case OpCode::Exp:
+            return std::exp(values[step.left]);
+        case OpCode::Log:
+            return std::log(values[step.left]);
+        case OpCode::Sin:
+            return std::sin(values[step.left]);
+        case OpCode::Cos:
+            return std::cos(values[step.left]);
+        default:
+            return std::sqrt(values[step.left]);
+    }
+}
+
+void IncrementalEvaluator::recomputeAll() {
+    while (!dirty.empty()) {
+        dirty.pop();
+    }
+    for (std::size_t i = 0; i < values.size(); i++) {
+        queued[i] = true;
+        dirty.push(static_cast<std::uint32_t>(i));
+    }
+}
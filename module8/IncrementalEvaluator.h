@@ -0,0 +1,58 @@
+#pragma once
+#include "CompiledExpression.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <string>
+#include <vector>
+
+// Keeps the value of every instruction of a compiled expression between evaluations and, when
+// only some variables change, recomputes just the instructions that depend on them: the paths
+// from the changed variables towards the root. A path stops early where a recomputed value
+// comes out unchanged. The cost follows the size of the change, not the size of the expression.
+//
+// The CompiledExpression must outlive the evaluator. Not thread-safe.
+class IncrementalEvaluator {
+    public:
+        // Evaluates everything once with the given slot values
+        IncrementalEvaluator(const CompiledExpression& expression, const double* slots);
+        IncrementalEvaluator(const CompiledExpression& expression, const SymbolTable& symbols);
+
+        // Change one variable; nothing is recomputed until evaluate()
+        void set(std::size_t slot, double value);
+        void set(const std::string& name, double value);
+
+        // Value of the expression with the current variables; throws std::runtime_error on a
+        // division by zero the result depends on (not one in a branch no Select picks)
+        double evaluate();
+
+        // Instructions recomputed by the last evaluate()
+        std::size_t recomputed() const { return lastRecomputed; }
+
+    private:
+        // Recompute instruction i from its operands' current values, and the errors it depends on
+        double compute(std::size_t i, EvalErrors& fault) const;
+
+        // Mark every instruction dirty
+        void recomputeAll();
+
+        const CompiledExpression& expression;
+        std::vector<double> slotValues;
+        std::vector<double> values;
+
+        // Errors each value depends on; a division by zero is NaN with EVAL_DIVIDE_BY_ZERO here
+        std::vector<EvalErrors> faults;
+
+        // Users of each instruction and Variable instructions of each slot (CSR: the entries
+        // for i are [start[i], start[i + 1]) of the list)
+        std::vector<std::uint32_t> userStart;
+        std::vector<std::uint32_t> users;
+        std::vector<std::uint32_t> slotStart;
+        std::vector<std::uint32_t> slotReaders;
+
+        // Dirty instructions, smallest index first so operands are always updated before users
+        std::priority_queue<std::uint32_t, std::vector<std::uint32_t>, std::greater<std::uint32_t>> dirty;
+        std::vector<bool> queued;
+        std::size_t lastRecomputed = 0;
+};
@@ -0,0 +1,238 @@
+#include "JitExpression.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define EXPRESSION_JIT_AVAILABLE
+#include <dlfcn.h>
+#include <unistd.h>
+#endif
+
+// Exact C++ spelling of a constant: hexadecimal floats round-trip every finite double
+static std::string literal(double value) {
+    if (std::isnan(value)) {
+        return "std::numeric_limits<double>::quiet_NaN()";
+    }
+    if (std::isinf(value)) {
+        return value > 0 ? "std::numeric_limits<double>::infinity()" : "-std::numeric_limits<double>::infinity()";
+    }
+    char buffer[64];
+    std::snprintf(buffer, sizeof(buffer), "%a", value);
+    return std::string("(") + buffer + ")";
+}
+
+// Text in single quotes for the shell, with each quote inside it written as '\''
+static std::string shellQuoted(const std::string& text) {
+    std::string quoted = "'";
+    for (char c : text) {
+        quoted += c == '\'' ? std::string("'\\''") : std::string(1, c);
+    }
+    return quoted + "'";
+}
+
+/*
+JITEXPRESSION FUNCTIONS
+*/
+JitExpression::JitExpression(const node_ptr& root) : tape(root) {
+    compile();
+}
+
+JitExpression::JitExpression(const CompiledExpression& expression) : tape(expression) {
+    compile();
+}
+
+JitExpression::~JitExpression() {
+#ifdef EXPRESSION_JIT_AVAILABLE
+    if (library) {
+        dlclose(library);
+    }
+#endif
+}
+
+JitExpression::JitExpression(JitExpression&& other) noexcept
+    : tape(std::move(other.tape)), library(other.library), function(other.function),
+      failure(std::move(other.failure)) {
+    other.library = nullptr;
+    other.function = nullptr;
+}
+
+JitExpression& JitExpression::operator=(JitExpression&& other) noexcept {
+    if (this != &other) {
+        std::swap(tape, other.tape);
+        std::swap(library, other.library);
+        std::swap(function, other.function);
+        std::swap(failure, other.failure);
+    }
+    return *this;
+}
+
+double JitExpression::evaluate(const double* slots) const {
+    if (!function) {
+        return tape.evaluate(slots);
+    }
+    EvalErrors errors = 0;
+    double result = function(slots, &errors);
+    if (errors != 0) {
+        evaluationError(nullptr, errors, "Cannot divide by 0!");
+    }
+    return result;
+}
+
+double JitExpression::tryEvaluate(const double* slots, EvalErrors& errors) const {
+    return function ? function(slots, &errors) : tape.tryEvaluate(slots, errors);
+}
+
+double JitExpression::evaluate(const SymbolTable& symbols) const {
+    std::vector<double> slots = tape.bind(symbols);
+    return evaluate(slots.data());
+}
+
+std::string JitExpression::generateSource() const {
+    std::ostringstream source;
+    source << "#include <algorithm>\n"
+              "#include <cmath>\n"
+              "#include <cstdint>\n"
+              "#include <limits>\n\n"
+              "extern \"C\" double evaluate_expression(const double* slots, std::uint8_t* errors) {\n";
+
+    // Instructions that depend on a division get a flag fN: whether a divisor they depend on,
+    // through the branches their Selects pick, is zero. The result's flag decides the error
+    const Instruction* code = tape.code();
+    const double* constants = tape.constantPool();
+    std::vector<bool> flagged(tape.size(), false);
+    for (std::size_t i = 0; i < tape.size(); i++) {
+        const Instruction& step = code[i];
+        bool divides = step.op == OpCode::Div;
+        for (std::size_t k = 0; k < arity(step.op); k++) {
+            divides = divides || flagged[step.operand(k)];
+        }
+        flagged[i] = divides;
+        if (divides) {
+            source << "    const bool f" << i << " = ";
+            auto flag = [&flagged](std::uint32_t index) {
+                return flagged[index] ? "f" + std::to_string(index) : std::string("false");
+            };
+            if (step.op == OpCode::Select) {
+                source << flag(step.left) << " || (v" << step.left << " > 0.0 ? " << flag(step.right) << " : "
+                       << flag(step.third) << ")";
+            } else {
+                const char* separator = "";
+                if (step.op == OpCode::Div) {
+                    source << "v" << step.right << " == 0.0";
+                    separator = " || ";
+                }
+                for (std::size_t k = 0; k < arity(step.op); k++) {
+                    if (flagged[step.operand(k)]) {
+                        source << separator << "f" << step.operand(k);
+                        separator = " || ";
+                    }
+                }
+            }
+            source << ";\n";
+        }
+
+        source << "    const double v" << i << " = ";
+        switch (step.op) {
+            case OpCode::Constant:
+                source << literal(constants[step.left]);
+                break;
+            case OpCode::Variable:
+                source << "slots[" << step.left << "]";
+                break;
+            case OpCode::Add:
+                source << "v" << step.left << " + v" << step.right;
+                break;
+            case OpCode::Sub:
+                source << "v" << step.left << " - v" << step.right;
+                break;
+            case OpCode::Mul:
+                source << "v" << step.left << " * v" << step.right;
+                break;
+            case OpCode::Div:
+                source << "v" << step.right << " == 0.0 ? std::numeric_limits<double>::quiet_NaN() : v" << step.left
+                       << " / v" << step.right;
+                break;
+            case OpCode::Pow:
+                source << "std::pow(v" << step.left << ", v" << step.right << ")";
+                break;
+            case OpCode::Min:
+                source << "std::min(v" << step.left << ", v" << step.right << ")";
+                break;
+            case OpCode::Max:
+                source << "std::max(v" << step.left << ", v" << step.right << ")";
+                break;
+            case OpCode::Exp:
+                source << "std::exp(v" << step.left << ")";
+                break;
+            case OpCode::Log:
+                source << "std::log(v" << step.left << ")";
+                break;
+            case OpCode::Sin:
+                source << "std::sin(v" << step.left << ")";
+                break;
+            case OpCode::Cos:
+                source << "std::cos(v" << step.left << ")";
+                break;
+            case OpCode::Sqrt:
+                source << "std::sqrt(v" << step.left << ")";
+                break;
+            case OpCode::Select:
+                source << "v" << step.left << " > 0.0 ? v" << step.right << " : v" << step.third;
+                break;
+        }
+        source << ";\n";
+    }
+    if (flagged[tape.size() - 1]) {
+        source << "    if (f" << tape.size() - 1 << ") {\n"
+                  "        *errors |= " << static_cast<int>(EVAL_DIVIDE_BY_ZERO) << ";\n"
+                  "    }\n";
+    }
+    source << "    return v" << tape.size() - 1 << ";\n}\n";
+    return source.str();
+}
+
+void JitExpression::compile() {
+#ifdef EXPRESSION_JIT_AVAILABLE
+    const char* tmp = std::getenv("TMPDIR");
+    std::string directory = std::string(tmp && *tmp ? tmp : "/tmp") + "/expression-jit-XXXXXX";
+    if (!mkdtemp(&directory[0])) {
+        failure = "Cannot create a directory for the generated code";
+        return;
+    }
+    std::string sourcePath = directory + "/expression.cpp";
+    std::string libraryPath = directory + "/expression.so";
+    std::string logPath = directory + "/compiler.log";
+
+    std::ofstream(sourcePath) << generateSource();
+
+    const char* compiler = std::getenv("CXX");
+    std::string command = std::string(compiler && *compiler ? compiler : "c++") + " -std=c++17 -O2 -shared -fPIC -o "
+                          + shellQuoted(libraryPath) + " " + shellQuoted(sourcePath) + " > " + shellQuoted(logPath)
+                          + " 2>&1";
+    if (std::system(command.c_str()) != 0) {
+        std::ifstream log(logPath);
+        std::ostringstream output;
+        output << log.rdbuf();
+        failure = "Compiler failed: " + output.str();
+    } else if (!(library = dlopen(libraryPath.c_str(), RTLD_NOW | RTLD_LOCAL))) {
+        failure = std::string("Cannot load the generated code: ") + dlerror();
+    } else if (!(function = reinterpret_cast<NativeFunction>(dlsym(library, "evaluate_expression")))) {
+        failure = "Generated code has no evaluate_expression";
+        dlclose(library);
+        library = nullptr;
+    }
+
+    // The loaded library stays mapped after its file is gone
+    std::remove(sourcePath.c_str());
+    std::remove(libraryPath.c_str());
+    std::remove(logPath.c_str());
+    rmdir(directory.c_str());
+#else
+    failure = "Native compilation is not supported on this platform";
+#endif
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "CompiledExpression.h"
+#include <cstddef>
+#include <string>
+
+// Native code for one expression: the tape is written out as straight-line C++ (one local per
+// instruction), compiled into a shared library with the system compiler and loaded in-process,
+// so evaluation is a plain function call with no dispatch at all. Worth it for expressions
+// evaluated millions of times; compiling takes a fraction of a second or more.
+//
+// Needs a Unix system with a C++ compiler on the PATH ($CXX, else c++). If anything fails the
+// object keeps working on the compiled tape; native() says which one is in use and error() why.
+class JitExpression {
+    public:
+        // Evaluates with slots[i] as the value of the variable in slot i (as CompiledExpression).
+        // Never throws, as exceptions must not cross the loaded library's boundary: errors are
+        // ORed into *errors as CompiledExpression::tryEvaluate does
+        using NativeFunction = double (*)(const double* slots, EvalErrors* errors);
+
+        explicit JitExpression(const node_ptr& root);
+        explicit JitExpression(const CompiledExpression& expression);
+        ~JitExpression();
+
+        JitExpression(const JitExpression&) = delete;
+        JitExpression& operator=(const JitExpression&) = delete;
+        JitExpression(JitExpression&& other) noexcept;
+        JitExpression& operator=(JitExpression&& other) noexcept;
+
+        // Throw std::runtime_error on division by zero, as CompiledExpression does
+        double evaluate(const double* slots) const;
+        double evaluate(const SymbolTable& symbols) const;
+
+        // Same as above without throwing; errors as in CompiledExpression::tryEvaluate
+        double tryEvaluate(const double* slots, EvalErrors& errors) const;
+
+        // The native function, or nullptr if compiling failed. Unlike evaluate it may be called
+        // from several threads at once
+        NativeFunction nativeFunction() const { return function; }
+
+        bool native() const { return function != nullptr; }
+        const std::string& error() const { return failure; }
+
+        const CompiledExpression& compiled() const { return tape; }
+
+    private:
+        // C++ source of a function evaluating the tape
+        std::string generateSource() const;
+
+        // Compile and load the source; on failure leave function null and set failure
+        void compile();
+
+        CompiledExpression tape;
+        void* library = nullptr;
+        NativeFunction function = nullptr;
+        std::string failure;
+};
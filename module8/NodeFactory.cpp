@@ -0,0 +1,270 @@
+#include "NodeFactory.h"
+#include "Simplifier.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/*
+NODEFACTORY FUNCTIONS
+*/
+std::size_t NodeFactory::NodeKeyHash::operator()(const NodeKey& key) const {
+    std::size_t hash = std::hash<const Node*>()(key.children[0]);
+    hash ^= std::hash<const Node*>()(key.children[1]) + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    hash ^= std::hash<const Node*>()(key.children[2]) + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    return hash ^ static_cast<std::size_t>(key.op);
+}
+
+node_ptr NodeFactory::constant(double value) {
+    std::uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    node_ptr& node = constants[bits];
+    if (!node) {
+        node = std::make_shared<Constant>(value);
+        owned.insert(node.get());
+    }
+    return node;
+}
+
+node_ptr NodeFactory::variable(const std::string& name) {
+    node_ptr& node = variables[name];
+    if (!node) {
+        node = std::make_shared<Variable>(name);
+        owned.insert(node.get());
+    }
+    return node;
+}
+
+node_ptr NodeFactory::add(const node_ptr& left, const node_ptr& right) {
+    return intern(makeAdd(intern(left), intern(right)));
+}
+
+node_ptr NodeFactory::sub(const node_ptr& left, const node_ptr& right) {
+    return intern(makeSub(intern(left), intern(right)));
+}
+
+node_ptr NodeFactory::mul(const node_ptr& left, const node_ptr& right) {
+    return intern(makeMul(intern(left), intern(right)));
+}
+
+node_ptr NodeFactory::div(const node_ptr& left, const node_ptr& right) {
+    return intern(makeDiv(intern(left), intern(right)));
+}
+
+node_ptr NodeFactory::pow(const node_ptr& left, const node_ptr& right) {
+    return intern(makePow(intern(left), intern(right)));
+}
+
+node_ptr NodeFactory::min(const node_ptr& left, const node_ptr& right) {
+    return intern(makeMin(intern(left), intern(right)));
+}
+
+node_ptr NodeFactory::max(const node_ptr& left, const node_ptr& right) {
+    return intern(makeMax(intern(left), intern(right)));
+}
+
+node_ptr NodeFactory::exp(const node_ptr& operand) {
+    return intern(makeExp(intern(operand)));
+}
+
+node_ptr NodeFactory::log(const node_ptr& operand) {
+    return intern(makeLog(intern(operand)));
+}
+
+node_ptr NodeFactory::sin(const node_ptr& operand) {
+    return intern(makeSin(intern(operand)));
+}
+
+node_ptr NodeFactory::cos(const node_ptr& operand) {
+    return intern(makeCos(intern(operand)));
+}
+
+node_ptr NodeFactory::sqrt(const node_ptr& operand) {
+    return intern(makeSqrt(intern(operand)));
+}
+
+node_ptr NodeFactory::select(const node_ptr& condition, const node_ptr& ifTrue, const node_ptr& ifFalse) {
+    return intern(makeSelect(intern(condition), intern(ifTrue), intern(ifFalse)));
+}
+
+node_ptr NodeFactory::make(OpCode op, const node_ptr* children) {
+    node_ptr interned[3];
+    for (std::size_t i = 0; i < arity(op); i++) {
+        interned[i] = intern(children[i]);
+    }
+    return intern(makeSimplified(op, interned));
+}
+
+node_ptr NodeFactory::intern(const node_ptr& root) {
+    if (!root || owned.count(root.get())) {
+        return root;
+    }
+
+    // Post-order walk that stops at nodes the factory already holds
+    std::unordered_map<const Node*, node_ptr> interned;
+    std::vector<std::pair<node_ptr, bool>> pending{{root, false}};
+    while (!pending.empty()) {
+        node_ptr node = pending.back().first;
+        bool childrenDone = pending.back().second;
+        pending.pop_back();
+        if (interned.count(node.get())) {
+            continue;
+        }
+        if (owned.count(node.get())) {
+            interned[node.get()] = node;
+            continue;
+        }
+
+        switch (node->opcode()) {
+            case OpCode::Constant:
+                interned[node.get()] = constant(static_cast<const Constant&>(*node).getValue());
+                break;
+            case OpCode::Variable:
+                interned[node.get()] = variable(static_cast<const Variable&>(*node).getName());
+                break;
+            default: {
+                std::size_t count = arity(node->opcode());
+                if (!childrenDone) {
+                    pending.push_back({node, true});
+                    for (std::size_t i = count; i-- > 0;) {
+                        pending.push_back({node->child(i), false});
+                    }
+                    break;
+                }
+                node_ptr children[3];
+                for (std::size_t i = 0; i < count; i++) {
+                    children[i] = interned[node->child(i).get()];
+                }
+                interned[node.get()] = internNode(node->opcode(), children, node);
+                break;
+            }
+        }
+    }
+    return interned[root.get()];
+}
+
+node_ptr NodeFactory::internNode(OpCode op, const node_ptr* children, const node_ptr& original) {
+    std::size_t count = arity(op);
+    NodeKey key{op, {nullptr, nullptr, nullptr}};
+    for (std::size_t i = 0; i < count; i++) {
+        key.children[i] = children[i].get();
+    }
+    node_ptr& node = operations[key];
+    if (node) {
+        return node;
+    }
+
+    bool sameChildren = original != nullptr;
+    for (std::size_t i = 0; i < count && sameChildren; i++) {
+        sameChildren = original->child(i) == children[i];
+    }
+    node = sameChildren ? original : makeNode(op, children);
+    owned.insert(node.get());
+    return node;
+}
+
+void NodeFactory::clear() {
+    constants.clear();
+    variables.clear();
+    operations.clear();
+    owned.clear();
+}
+
+/*
+SHARED EVALUATION
+*/
+double evaluateShared(const node_ptr& root, const SymbolTable& symbols, EvalErrors* errors) {
+    if (!root) {
+        throw std::invalid_argument("Cannot evaluate a null expression");
+    }
+
+    std::unordered_map<const Node*, double> values;
+    std::vector<std::pair<const Node*, bool>> pending{{root.get(), false}};
+    while (!pending.empty()) {
+        const Node* node = pending.back().first;
+        bool childrenDone = pending.back().second;
+        pending.pop_back();
+        if (values.count(node)) {
+            continue;
+        }
+
+        OpCode op = node->opcode();
+        if (op == OpCode::Constant || op == OpCode::Variable) {
+            values[node] = node->compute(symbols, errors);
+            continue;
+        }
+        // A Select waits for its condition, then for the branch it picks, and only that one
+        if (op == OpCode::Select) {
+            const Node* condition = node->child(0).get();
+            if (!childrenDone) {
+                pending.push_back({node, true});
+                pending.push_back({condition, false});
+                continue;
+            }
+            const Node* chosen = node->child(values[condition] > 0.0 ? 1 : 2).get();
+            auto itr = values.find(chosen);
+            if (itr == values.end()) {
+                pending.push_back({node, true});
+                pending.push_back({chosen, false});
+            } else {
+                double value = itr->second;
+                values[node] = value;
+            }
+            continue;
+        }
+        std::size_t count = arity(op);
+        if (!childrenDone) {
+            pending.push_back({node, true});
+            for (std::size_t i = count; i-- > 0;) {
+                pending.push_back({node->child(i).get(), false});
+            }
+            continue;
+        }
+
+        double left = values[node->child(0).get()];
+        double right = count > 1 ? values[node->child(1).get()] : 0.0;
+        switch (op) {
+            case OpCode::Add:
+                values[node] = left + right;
+                break;
+            case OpCode::Sub:
+                values[node] = left - right;
+                break;
+            case OpCode::Mul:
+                values[node] = left * right;
+                break;
+            case OpCode::Div:
+                values[node] = right == 0.0 ? evaluationError(errors, EVAL_DIVIDE_BY_ZERO, "Cannot divide by 0!")
+                                            : left / right;
+                break;
+            case OpCode::Pow:
+                values[node] = std::pow(left, right);
+                break;
+            case OpCode::Min:
+                values[node] = std::min(left, right);
+                break;
+            case OpCode::Max:
+                values[node] = std::max(left, right);
+                break;
+            case OpCode::Exp:
+                values[node] = std::exp(left);
+                break;
+            case OpCode::Log:
+                values[node] = std::log(left);
+                break;
+            case OpCode::Sin:
+                values[node] = std::sin(left);
+                break;
+            case OpCode::Cos:
+                values[node] = std::cos(left);
+                break;
+            default:
+                values[node] = std::sqrt(left);
+                break;
+        }
+    }
+    return values[root.get()];
+}
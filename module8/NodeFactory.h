@@ -0,0 +1,73 @@
+#pragma once
+#include "ExpressionTree.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+// Hash-consing node factory: asking for a node equal in structure to one it already holds
+// returns that node, so equal subtrees are one shared node and comparing two interned trees
+// is a pointer comparison. The operation builders simplify like makeAdd etc. before interning.
+// Compiling an interned tree (CompiledExpression) gives one instruction per distinct node.
+//
+// The factory keeps its nodes alive until clear() or destruction, and is not thread-safe.
+class NodeFactory {
+    public:
+        node_ptr constant(double value);
+        node_ptr variable(const std::string& name);
+        node_ptr add(const node_ptr& left, const node_ptr& right);
+        node_ptr sub(const node_ptr& left, const node_ptr& right);
+        node_ptr mul(const node_ptr& left, const node_ptr& right);
+        node_ptr div(const node_ptr& left, const node_ptr& right);
+        node_ptr pow(const node_ptr& left, const node_ptr& right);
+        node_ptr min(const node_ptr& left, const node_ptr& right);
+        node_ptr max(const node_ptr& left, const node_ptr& right);
+        node_ptr exp(const node_ptr& operand);
+        node_ptr log(const node_ptr& operand);
+        node_ptr sin(const node_ptr& operand);
+        node_ptr cos(const node_ptr& operand);
+        node_ptr sqrt(const node_ptr& operand);
+        node_ptr select(const node_ptr& condition, const node_ptr& ifTrue, const node_ptr& ifFalse);
+
+        // Any of the operations above by its kind, over arity(op) children
+        node_ptr make(OpCode op, const node_ptr* children);
+
+        // The interned equivalent of any tree, with every repeated subtree merged into one node.
+        // Nodes already held are returned as they are, without walking their subtrees
+        node_ptr intern(const node_ptr& root);
+
+        // Number of distinct nodes held
+        std::size_t size() const { return owned.size(); }
+
+        void clear();
+
+    private:
+        // Identity of an operation node: its kind and its (interned) children, null past its arity
+        struct NodeKey {
+            OpCode op;
+            const Node* children[3];
+            bool operator==(const NodeKey& other) const {
+                return op == other.op && children[0] == other.children[0] && children[1] == other.children[1]
+                       && children[2] == other.children[2];
+            }
+        };
+        struct NodeKeyHash {
+            std::size_t operator()(const NodeKey& key) const;
+        };
+
+        // Interned operation node over interned children; original (if not null) is reused if
+        // it already has them
+        node_ptr internNode(OpCode op, const node_ptr* children, const node_ptr& original);
+
+        // Constants are keyed by their bit pattern, so 0.0 and -0.0 stay distinct
+        std::unordered_map<std::uint64_t, node_ptr> constants;
+        std::unordered_map<std::string, node_ptr> variables;
+        std::unordered_map<NodeKey, node_ptr, NodeKeyHash> operations;
+        std::unordered_set<const Node*> owned;
+};
+
+// Evaluate a tree or DAG, computing each distinct node once per call, so shared subtrees
+// (such as the three uses of v in the derivative of u / v) are not recomputed. Throws on an
+// error if errors is null, else reports it there as Node::tryEvaluate does
+double evaluateShared(const node_ptr& root, const SymbolTable& symbols, EvalErrors* errors = nullptr);
@@ -0,0 +1,254 @@
+#include "ParallelExpression.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+/*
+PARALLELEXPRESSION FUNCTIONS
+*/
+ParallelExpression::ParallelExpression(const node_ptr& root, ThreadPool& pool, std::size_t threshold)
+    : pool(pool) {
+    build(root, threshold, true);
+}
+
+ParallelExpression::ParallelExpression(const node_ptr& root, const std::vector<std::string>& slotNames,
+                                       ThreadPool& pool, std::size_t threshold)
+    : pool(pool), variableNames(slotNames) {
+    std::unordered_set<std::string> seen;
+    for (const std::string& name : slotNames) {
+        if (!seen.insert(name).second) {
+            throw std::invalid_argument("Variable has more than one slot: " + name);
+        }
+    }
+    build(root, threshold, false);
+}
+
+void ParallelExpression::build(const node_ptr& root, std::size_t threshold, bool assignSlots) {
+    if (!root) {
+        throw std::invalid_argument("Cannot compile a null expression");
+    }
+
+    // Post-order over distinct nodes, with the size of each subtree. Sizes stop growing past
+    // twice the threshold, which is all the split needs (and keeps shared subtrees of a DAG,
+    // counted once per use, from overflowing)
+    std::size_t cap = std::max<std::size_t>(threshold, 1) * 2;
+    std::unordered_map<const Node*, std::size_t> sizes;
+    std::vector<node_ptr> order;
+    std::unordered_set<std::string> names(variableNames.begin(), variableNames.end());
+    std::vector<std::pair<node_ptr, bool>> walk{{root, false}};
+    while (!walk.empty()) {
+        node_ptr node = walk.back().first;
+        bool childrenDone = walk.back().second;
+        walk.pop_back();
+        if (sizes.count(node.get())) {
+            continue;
+        }
+        std::size_t count = arity(node->opcode());
+        if (count > 0 && !childrenDone) {
+            walk.push_back({node, true});
+            for (std::size_t i = count; i-- > 0;) {
+                walk.push_back({node->child(i), false});
+            }
+            continue;
+        }
+
+        std::size_t size = 1;
+        for (std::size_t i = 0; i < count; i++) {
+            size = std::min(cap, size + sizes[node->child(i).get()]);
+        }
+        sizes[node.get()] = size;
+        order.push_back(node);
+        if (node->opcode() == OpCode::Variable) {
+            const std::string& name = static_cast<const Variable&>(*node).getName();
+            if (names.insert(name).second) {
+                if (!assignSlots) {
+                    throw std::invalid_argument("Variable has no slot: " + name);
+                }
+                variableNames.push_back(name);
+            }
+        }
+    }
+
+    // Tasks: the root, and every child of at least threshold nodes that has such a sibling
+    std::unordered_map<const Node*, std::uint32_t> taskIndex{{root.get(), 0}};
+    std::vector<const Node*> taskRoots{root.get()};
+    for (const node_ptr& node : order) {
+        std::size_t count = arity(node->opcode());
+        std::size_t big = 0;
+        for (std::size_t i = 0; i < count; i++) {
+            big += sizes[node->child(i).get()] >= threshold;
+        }
+        if (big < 2) {
+            continue;
+        }
+        for (std::size_t i = 0; i < count; i++) {
+            const Node* child = node->child(i).get();
+            if (sizes[child] >= threshold && taskIndex.emplace(child, static_cast<std::uint32_t>(taskRoots.size())).second) {
+                taskRoots.push_back(child);
+            }
+        }
+    }
+
+    // Inside the task above it, a task's subtree is replaced by a variable standing for its
+    // result, named with a prefix no real variable starts with
+    std::string prefix = "#";
+    while (std::any_of(names.begin(), names.end(),
+                       [&prefix](const std::string& name) { return name.compare(0, prefix.size(), prefix) == 0; })) {
+        prefix += "#";
+    }
+    std::unordered_map<std::string, std::uint32_t> inputIndex;
+    for (std::size_t i = 0; i < variableNames.size(); i++) {
+        inputIndex.emplace(variableNames[i], static_cast<std::uint32_t>(i));
+    }
+    std::vector<node_ptr> placeholders;
+    for (std::size_t t = 0; t < taskRoots.size(); t++) {
+        std::string name = prefix + std::to_string(t);
+        inputIndex.emplace(name, static_cast<std::uint32_t>(variableNames.size() + t));
+        placeholders.push_back(std::make_shared<Variable>(name));
+    }
+
+    // Rebuild each node over its children as the task above it sees them; nodes whose children
+    // are unchanged are kept as they are
+    std::unordered_map<const Node*, node_ptr> rebuilt;
+    std::vector<node_ptr> taskTrees(taskRoots.size());
+    for (const node_ptr& node : order) {
+        std::size_t count = arity(node->opcode());
+        node_ptr children[3];
+        bool changed = false;
+        for (std::size_t i = 0; i < count; i++) {
+            const node_ptr& child = node->child(i);
+            auto task = taskIndex.find(child.get());
+            children[i] = task != taskIndex.end() ? placeholders[task->second] : rebuilt[child.get()];
+            changed = changed || children[i] != child;
+        }
+        node_ptr own = changed ? makeNode(node->opcode(), children) : node;
+
+        auto task = taskIndex.find(node.get());
+        if (task != taskIndex.end()) {
+            taskTrees[task->second] = own;
+        } else {
+            rebuilt[node.get()] = own;
+        }
+    }
+
+    // Compile each task, taking its dependencies from the task results it reads
+    tasks.reserve(taskTrees.size());
+    for (const node_ptr& tree : taskTrees) {
+        tasks.emplace_back(CompiledExpression(tree));
+    }
+    for (std::size_t t = 0; t < tasks.size(); t++) {
+        Task& task = tasks[t];
+        for (const std::string& name : task.code.variables()) {
+            std::uint32_t index = inputIndex.at(name);
+            task.slots.push_back(index);
+            if (index >= variableNames.size()) {
+                tasks[index - variableNames.size()].dependents.push_back(static_cast<std::uint32_t>(t));
+                task.dependencies++;
+            }
+        }
+        task.locals.resize(task.slots.size());
+        task.localFaults.resize(task.slots.size());
+    }
+
+    inputs.assign(variableNames.size() + tasks.size(), 0.0);
+    inputFaults.assign(variableNames.size() + tasks.size(), 0);
+    pending.reset(new std::atomic<std::uint32_t>[tasks.size()]);
+}
+
+double ParallelExpression::evaluate(const double* slots) {
+    std::copy(slots, slots + variableNames.size(), inputs.begin());
+    failed = false;
+    error = nullptr;
+    remaining = tasks.size();
+    for (std::size_t t = 0; t < tasks.size(); t++) {
+        pending[t] = tasks[t].dependencies;
+    }
+
+    if (tasks.size() == 1) {
+        runTask(0);
+    } else {
+        for (std::size_t t = 0; t < tasks.size(); t++) {
+            if (tasks[t].dependencies == 0) {
+                submit(static_cast<std::uint32_t>(t));
+            }
+        }
+
+        // Help with the tasks; sleep only while every ready one is already running elsewhere
+        while (remaining.load() > 0) {
+            std::size_t seen = started.load();
+            if (!pool.runPendingTask()) {
+                std::unique_lock<std::mutex> lock(doneMutex);
+                done.wait(lock, [this, seen]() { return remaining.load() == 0 || started.load() != seen; });
+            }
+        }
+        std::lock_guard<std::mutex> lock(doneMutex);
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    if (inputFaults[variableNames.size()] != 0) {
+        evaluationError(nullptr, inputFaults[variableNames.size()], "Cannot divide by 0!");
+    }
+    return inputs[variableNames.size()];
+}
+
+double ParallelExpression::evaluate(const SymbolTable& symbols) {
+    std::vector<double> slots(variableNames.size());
+    for (std::size_t i = 0; i < variableNames.size(); i++) {
+        auto itr = symbols.find(variableNames[i]);
+        if (itr == symbols.end()) {
+            throw std::runtime_error("Variable value not found for: " + variableNames[i]);
+        }
+        slots[i] = itr->second;
+    }
+    return evaluate(slots.data());
+}
+
+void ParallelExpression::submit(std::uint32_t t) {
+    pool.submit([this, t]() { runTask(t); });
+}
+
+void ParallelExpression::runTask(std::uint32_t t) {
+    // A division by zero is passed on as a fault of the result. Once a task has thrown anything
+    // else the rest only pass NaN along, so every task still completes
+    Task& task = tasks[t];
+    double result = std::numeric_limits<double>::quiet_NaN();
+    EvalErrors faults = 0;
+    if (!failed.load()) {
+        try {
+            for (std::size_t i = 0; i < task.slots.size(); i++) {
+                task.locals[i] = inputs[task.slots[i]];
+                task.localFaults[i] = inputFaults[task.slots[i]];
+            }
+            result = task.code.tryEvaluate(task.locals.data(), task.localFaults.data(), faults);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(doneMutex);
+            if (!failed.exchange(true)) {
+                error = std::current_exception();
+            }
+        }
+    }
+    inputs[variableNames.size() + t] = result;
+    inputFaults[variableNames.size() + t] = faults;
+
+    bool startedAny = false;
+    for (std::uint32_t dependent : task.dependents) {
+        if (pending[dependent].fetch_sub(1) == 1) {
+            submit(dependent);
+            startedAny = true;
+        }
+    }
+
+    // The last task finishes under the lock, so the caller cannot return (and the object go
+    // away) while this thread still uses it
+    std::lock_guard<std::mutex> lock(doneMutex);
+    if (startedAny) {
+        started++;
+    }
+    remaining--;
+    done.notify_all();
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include "CompiledExpression.h"
+#include "ThreadPool.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Subtrees smaller than this (in nodes) are not worth a task of their own
+const std::size_t PARALLEL_THRESHOLD = 4096;
+
+// Evaluates one huge expression on all the threads of a pool. Wherever a node has two or more
+// children of at least threshold nodes (both sides of a big Add or Mul, say), each of those
+// children becomes a task; they run at the same time, and their parent's task runs once they
+// are all done. Each task is compiled to its own tape, with the results of the tasks below it
+// read like variables, so the work inside a task is the plain tape loop. An expression with
+// no such split is a single task evaluated on the calling thread.
+//
+// evaluate reuses state owned by the object, so one object must not be evaluated from several
+// threads at once. The pool must outlive the object.
+class ParallelExpression {
+    public:
+        // Variables get slots in the order they first appear, as with CompiledExpression
+        ParallelExpression(const node_ptr& root, ThreadPool& pool, std::size_t threshold = PARALLEL_THRESHOLD);
+
+        // Variables get the slots of their names in slotNames; throws std::invalid_argument if
+        // a variable of the tree has no slot
+        ParallelExpression(const node_ptr& root, const std::vector<std::string>& slotNames, ThreadPool& pool,
+                           std::size_t threshold = PARALLEL_THRESHOLD);
+
+        // Evaluate with slots[i] as the value of the variable in slot i. A division by zero the
+        // result depends on throws std::runtime_error once all tasks have finished
+        double evaluate(const double* slots);
+
+        // Evaluate with a symbol table; throws std::runtime_error if a variable is missing
+        double evaluate(const SymbolTable& symbols);
+
+        // Number of tasks the expression was split into
+        std::size_t numTasks() const { return tasks.size(); }
+
+        // Number of slots evaluate reads, and the variable name of each
+        std::size_t numSlots() const { return variableNames.size(); }
+        const std::vector<std::string>& variables() const { return variableNames; }
+
+    private:
+        struct Task {
+            explicit Task(CompiledExpression code) : code(std::move(code)) {}
+
+            CompiledExpression code;
+
+            // Index in inputs of each slot of code, and the values and faults gathered from there
+            std::vector<std::uint32_t> slots;
+            std::vector<double> locals;
+            std::vector<EvalErrors> localFaults;
+
+            std::vector<std::uint32_t> dependents;
+            std::uint32_t dependencies = 0;
+        };
+
+        // Split the tree into tasks and compile each one; with assignSlots, variables get slots
+        // in first-use order, else they must be in variableNames already
+        void build(const node_ptr& root, std::size_t threshold, bool assignSlots);
+
+        // Evaluate task t, then start any dependent whose last dependency this was
+        void runTask(std::uint32_t t);
+        void submit(std::uint32_t t);
+
+        ThreadPool& pool;
+        std::vector<std::string> variableNames;
+        std::vector<Task> tasks;
+
+        // Slot values followed by the result of each task, and the errors each depends on (a
+        // task's fault only counts if the task reading its result uses it)
+        std::vector<double> inputs;
+        std::vector<EvalErrors> inputFaults;
+
+        // Per-evaluation state: dependencies still running for each task, tasks not yet done,
+        // tasks started so far (so a waiting caller wakes up to help) and the first exception
+        std::unique_ptr<std::atomic<std::uint32_t>[]> pending;
+        std::atomic<std::size_t> remaining{0};
+        std::atomic<std::size_t> started{0};
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;
+        std::mutex doneMutex;
+        std::condition_variable done;
+};
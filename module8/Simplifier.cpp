@@ -0,0 +1,309 @@
+#include "Simplifier.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+static bool isConstant(const node_ptr& node) {
+    return node->opcode() == OpCode::Constant;
+}
+
+static double constantValue(const node_ptr& node) {
+    return static_cast<const Constant&>(*node).getValue();
+}
+
+static bool isConstant(const node_ptr& node, double value) {
+    return isConstant(node) && constantValue(node) == value;
+}
+
+static node_ptr constant(double value) {
+    return std::make_shared<Constant>(value);
+}
+
+// Cheap structural equality: the same node, or two equal leaves
+static bool sameTerm(const node_ptr& a, const node_ptr& b) {
+    if (a == b) {
+        return true;
+    }
+    if (a->opcode() != b->opcode()) {
+        return false;
+    }
+    if (a->opcode() == OpCode::Constant) {
+        return constantValue(a) == constantValue(b);
+    }
+    if (a->opcode() == OpCode::Variable) {
+        return static_cast<const Variable&>(*a).getName() == static_cast<const Variable&>(*b).getName();
+    }
+    return false;
+}
+
+// Canonical order of commutative operands: constants, then variables by name, then the rest
+static bool comesBefore(const node_ptr& a, const node_ptr& b) {
+    auto rank = [](const node_ptr& node) {
+        return node->opcode() == OpCode::Constant ? 0 : node->opcode() == OpCode::Variable ? 1 : 2;
+    };
+    if (rank(a) != rank(b)) {
+        return rank(a) < rank(b);
+    }
+    if (a->opcode() == OpCode::Variable) {
+        return static_cast<const Variable&>(*a).getName() < static_cast<const Variable&>(*b).getName();
+    }
+    return false;
+}
+
+/*
+BUILDERS
+*/
+node_ptr makeAdd(const node_ptr& left, const node_ptr& right) {
+    if (isConstant(left) && isConstant(right)) {
+        return constant(constantValue(left) + constantValue(right));
+    }
+    if (isConstant(left, 0.0)) {
+        return right;
+    }
+    if (isConstant(right, 0.0)) {
+        return left;
+    }
+    if (sameTerm(left, right)) {
+        return makeMul(constant(2.0), left);
+    }
+    if (comesBefore(right, left)) {
+        return makeAdd(right, left);
+    }
+
+    // c1 + (c2 + x) -> (c1 + c2) + x
+    if (isConstant(left) && right->opcode() == OpCode::Add) {
+        const BinaryOp& sum = static_cast<const BinaryOp&>(*right);
+        if (isConstant(sum.getLeft())) {
+            return makeAdd(constant(constantValue(left) + constantValue(sum.getLeft())), sum.getRight());
+        }
+    }
+    return std::make_shared<Add>(left, right);
+}
+
+node_ptr makeSub(const node_ptr& left, const node_ptr& right) {
+    if (isConstant(left) && isConstant(right)) {
+        return constant(constantValue(left) - constantValue(right));
+    }
+    if (isConstant(right, 0.0)) {
+        return left;
+    }
+    if (sameTerm(left, right)) {
+        return constant(0.0);
+    }
+    if (isConstant(left, 0.0)) {
+        return makeMul(constant(-1.0), right);
+    }
+    return std::make_shared<Sub>(left, right);
+}
+
+node_ptr makeMul(const node_ptr& left, const node_ptr& right) {
+    if (isConstant(left) && isConstant(right)) {
+        return constant(constantValue(left) * constantValue(right));
+    }
+    if (isConstant(left, 0.0) || isConstant(right, 0.0)) {
+        return constant(0.0);
+    }
+    if (isConstant(left, 1.0)) {
+        return right;
+    }
+    if (isConstant(right, 1.0)) {
+        return left;
+    }
+    if (comesBefore(right, left)) {
+        return makeMul(right, left);
+    }
+
+    // c1 * (c2 * x) -> (c1 * c2) * x
+    if (isConstant(left) && right->opcode() == OpCode::Mul) {
+        const BinaryOp& product = static_cast<const BinaryOp&>(*right);
+        if (isConstant(product.getLeft())) {
+            return makeMul(constant(constantValue(left) * constantValue(product.getLeft())), product.getRight());
+        }
+    }
+    return std::make_shared<Mul>(left, right);
+}
+
+node_ptr makeDiv(const node_ptr& left, const node_ptr& right) {
+    if (isConstant(left) && isConstant(right) && constantValue(right) != 0.0) {
+        return constant(constantValue(left) / constantValue(right));
+    }
+    if (isConstant(right, 1.0)) {
+        return left;
+    }
+    return std::make_shared<Div>(left, right);
+}
+
+node_ptr makePow(const node_ptr& left, const node_ptr& right) {
+    if (isConstant(left) && isConstant(right)) {
+        return constant(std::pow(constantValue(left), constantValue(right)));
+    }
+    if (isConstant(right, 1.0)) {
+        return left;
+    }
+
+    // As std::pow: x^0 and 1^y are 1 even for a NaN x or y
+    if (isConstant(right, 0.0) || isConstant(left, 1.0)) {
+        return constant(1.0);
+    }
+    return std::make_shared<Pow>(left, right);
+}
+
+node_ptr makeMin(const node_ptr& left, const node_ptr& right) {
+    if (isConstant(left) && isConstant(right)) {
+        return constant(std::min(constantValue(left), constantValue(right)));
+    }
+    if (sameTerm(left, right)) {
+        return left;
+    }
+    return std::make_shared<Min>(left, right);
+}
+
+node_ptr makeMax(const node_ptr& left, const node_ptr& right) {
+    if (isConstant(left) && isConstant(right)) {
+        return constant(std::max(constantValue(left), constantValue(right)));
+    }
+    if (sameTerm(left, right)) {
+        return left;
+    }
+    return std::make_shared<Max>(left, right);
+}
+
+node_ptr makeExp(const node_ptr& operand) {
+    if (isConstant(operand)) {
+        return constant(std::exp(constantValue(operand)));
+    }
+    return std::make_shared<Exp>(operand);
+}
+
+node_ptr makeLog(const node_ptr& operand) {
+    if (isConstant(operand)) {
+        return constant(std::log(constantValue(operand)));
+    }
+    return std::make_shared<Log>(operand);
+}
+
+node_ptr makeSin(const node_ptr& operand) {
+    if (isConstant(operand)) {
+        return constant(std::sin(constantValue(operand)));
+    }
+    return std::make_shared<Sin>(operand);
+}
+
+node_ptr makeCos(const node_ptr& operand) {
+    if (isConstant(operand)) {
+        return constant(std::cos(constantValue(operand)));
+    }
+    return std::make_shared<Cos>(operand);
+}
+
+node_ptr makeSqrt(const node_ptr& operand) {
+    if (isConstant(operand)) {
+        return constant(std::sqrt(constantValue(operand)));
+    }
+    return std::make_shared<Sqrt>(operand);
+}
+
+node_ptr makeSelect(const node_ptr& condition, const node_ptr& ifTrue, const node_ptr& ifFalse) {
+    if (isConstant(condition)) {
+        return constantValue(condition) > 0.0 ? ifTrue : ifFalse;
+    }
+    if (sameTerm(ifTrue, ifFalse)) {
+        return ifTrue;
+    }
+    return std::make_shared<Select>(condition, ifTrue, ifFalse);
+}
+
+node_ptr makeSimplified(OpCode op, const node_ptr* children) {
+    switch (op) {
+        case OpCode::Add:
+            return makeAdd(children[0], children[1]);
+        case OpCode::Sub:
+            return makeSub(children[0], children[1]);
+        case OpCode::Mul:
+            return makeMul(children[0], children[1]);
+        case OpCode::Div:
+            return makeDiv(children[0], children[1]);
+        case OpCode::Pow:
+            return makePow(children[0], children[1]);
+        case OpCode::Min:
+            return makeMin(children[0], children[1]);
+        case OpCode::Max:
+            return makeMax(children[0], children[1]);
+        case OpCode::Exp:
+            return makeExp(children[0]);
+        case OpCode::Log:
+            return makeLog(children[0]);
+        case OpCode::Sin:
+            return makeSin(children[0]);
+        case OpCode::Cos:
+            return makeCos(children[0]);
+        case OpCode::Sqrt:
+            return makeSqrt(children[0]);
+        case OpCode::Select:
+            return makeSelect(children[0], children[1], children[2]);
+        default:
+            throw std::invalid_argument("Constants and variables are not built from children");
+    }
+}
+
+/*
+WHOLE-TREE PASSES
+*/
+node_ptr simplify(const node_ptr& root) {
+    if (!root) {
+        return root;
+    }
+
+    // Post-order walk with an explicit stack; each distinct node is simplified once
+    std::unordered_map<const Node*, node_ptr> simplified;
+    std::vector<std::pair<node_ptr, bool>> pending{{root, false}};
+    while (!pending.empty()) {
+        node_ptr node = pending.back().first;
+        bool childrenDone = pending.back().second;
+        pending.pop_back();
+        if (simplified.count(node.get())) {
+            continue;
+        }
+
+        OpCode op = node->opcode();
+        if (op == OpCode::Constant || op == OpCode::Variable) {
+            simplified[node.get()] = node;
+            continue;
+        }
+        std::size_t count = arity(op);
+        if (!childrenDone) {
+            pending.push_back({node, true});
+            for (std::size_t i = count; i-- > 0;) {
+                pending.push_back({node->child(i), false});
+            }
+            continue;
+        }
+
+        node_ptr children[3];
+        for (std::size_t i = 0; i < count; i++) {
+            children[i] = simplified[node->child(i).get()];
+        }
+        simplified[node.get()] = makeSimplified(op, children);
+    }
+    return simplified[root.get()];
+}
+
+std::size_t countNodes(const node_ptr& root) {
+    std::size_t count = 0;
+    std::vector<const Node*> pending;
+    if (root) {
+        pending.push_back(root.get());
+    }
+    while (!pending.empty()) {
+        const Node* node = pending.back();
+        pending.pop_back();
+        count++;
+        for (std::size_t i = 0; i < arity(node->opcode()); i++) {
+            pending.push_back(node->child(i).get());
+        }
+    }
+    return count;
+}
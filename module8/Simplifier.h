@@ -0,0 +1,34 @@
+#pragma once
+#include "ExpressionTree.h"
+#include <cstddef>
+
+// Node builders that simplify as they build: constant operands are folded, identities and
+// annihilators are dropped (x + 0, x * 1, x * 0, x - x) and the operands of + and * are put
+// in a canonical order (constants first, then variables by name, then compound terms), so
+// x * y and y * x become the same tree. A division by a constant zero is never folded, so
+// it still throws when evaluated. Functions of constants are folded too, as are x^1, x^0,
+// min(x, x) and selects on a constant condition or between equal branches. derivative()
+// builds its results with these.
+node_ptr makeAdd(const node_ptr& left, const node_ptr& right);
+node_ptr makeSub(const node_ptr& left, const node_ptr& right);
+node_ptr makeMul(const node_ptr& left, const node_ptr& right);
+node_ptr makeDiv(const node_ptr& left, const node_ptr& right);
+node_ptr makePow(const node_ptr& left, const node_ptr& right);
+node_ptr makeMin(const node_ptr& left, const node_ptr& right);
+node_ptr makeMax(const node_ptr& left, const node_ptr& right);
+node_ptr makeExp(const node_ptr& operand);
+node_ptr makeLog(const node_ptr& operand);
+node_ptr makeSin(const node_ptr& operand);
+node_ptr makeCos(const node_ptr& operand);
+node_ptr makeSqrt(const node_ptr& operand);
+node_ptr makeSelect(const node_ptr& condition, const node_ptr& ifTrue, const node_ptr& ifFalse);
+
+// The builder above for op, over arity(op) children
+node_ptr makeSimplified(OpCode op, const node_ptr* children);
+
+// Rebuild a whole tree bottom-up with the builders above. Shared subtrees are simplified
+// once and stay shared, and the walk is iterative so deep trees cannot overflow the stack
+node_ptr simplify(const node_ptr& root);
+
+// Number of nodes in a tree, counting a shared subtree once for every place it appears
+std::size_t countNodes(const node_ptr& root);
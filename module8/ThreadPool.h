@@ -0,0 +1,39 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads sharing one task queue. Tasks here are coarse (a subtree of a
+// ParallelExpression, a run of batch blocks), so a single queue lock is never contended enough
+// to matter.
+class ThreadPool {
+    public:
+        // numThreads counts the calling thread, which runs queued tasks while it waits
+        // (0 uses std::thread::hardware_concurrency)
+        explicit ThreadPool(int numThreads = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // Number of threads that run tasks, the caller included
+        int size() const;
+
+        // Queue a task for any thread of the pool
+        void submit(std::function<void()> task);
+
+        // Run the oldest queued task on the calling thread, returning false if none was queued
+        bool runPendingTask();
+
+    private:
+        void workerLoop();
+
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::deque<std::function<void()>> tasks;
+        bool stopping = false;
+};
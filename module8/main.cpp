@@ -1,5 +1,18 @@
+#include "CompiledExpression.h"
+#include "ExpressionParser.h"
 #include "ExpressionTree.h"
+#include "IncrementalEvaluator.h"
+#include "JitExpression.h"
+#include "NodeFactory.h"
+#include "ParallelExpression.h"
+#include "Simplifier.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 int main() {
     // Symbol table creation
@@ -134,10 +147,388 @@ int main() {
                             std::make_shared<Constant>(0.0)
                     );
     std::cout << "Expression Tree: " << node9 << std::endl;
-    std::cout << "Evaluation: " << node9->evaluate(symTab) << std::endl;
+    try {
+        double value = node9->evaluate(symTab);
+        std::cout << "Evaluation: " << value << std::endl;
+    } catch (const std::runtime_error& error) {
+        std::cout << "Evaluation error: " << error.what() << std::endl;
+    }
     node_ptr derivedNode9 = node9->derivative("Zebra");
     std::cout << "Derivative: " << derivedNode9 << std::endl;
-    std::cout << "Evaluation of derivative: " << derivedNode9->evaluate(symTab) << std::endl;
+    try {
+        double value = derivedNode9->evaluate(symTab);
+        std::cout << "Evaluation of derivative: " << value << std::endl;
+    } catch (const std::runtime_error& error) {
+        std::cout << "Evaluation of derivative error: " << error.what() << std::endl;
+    }
+    std::cout << "\n";
+
+    std::cout << "TEST 10 (Compiled tape)" << std::endl;
+    CompiledExpression compiled6(node6);
+    std::cout << "Expression Tree: " << node6 << std::endl;
+    std::cout << "Tape instructions: " << compiled6.size() << std::endl;
+    std::cout << "Evaluation: " << compiled6.evaluate(symTab) << std::endl;
+    const int EVALUATIONS = 1000000;
+    double treeTotal = 0.0;
+    double tapeTotal = 0.0;
+    double lookupTotal = 0.0;
+    std::vector<double> slots10 = compiled6.bind(symTab);
+    auto treeStart = std::chrono::steady_clock::now();
+    for (int i = 0; i < EVALUATIONS; i++) {
+        treeTotal += node6->evaluate(symTab);
+    }
+    auto tapeStart = std::chrono::steady_clock::now();
+    for (int i = 0; i < EVALUATIONS; i++) {
+        tapeTotal += compiled6.evaluate(slots10.data());
+    }
+    auto lookupStart = std::chrono::steady_clock::now();
+    for (int i = 0; i < EVALUATIONS; i++) {
+        lookupTotal += compiled6.evaluate(symTab);
+    }
+    auto lookupEnd = std::chrono::steady_clock::now();
+    std::cout << "Tree vs tape (" << EVALUATIONS << " evaluations, variables bound once): "
+              << std::chrono::duration<double, std::milli>(tapeStart - treeStart).count() << " ms vs "
+              << std::chrono::duration<double, std::milli>(lookupStart - tapeStart).count() << " ms, totals "
+              << (treeTotal == tapeTotal ? "match" : "differ") << std::endl;
+    std::cout << "Tape with a symbol table lookup per evaluation: "
+              << std::chrono::duration<double, std::milli>(lookupEnd - lookupStart).count() << " ms, totals "
+              << (treeTotal == lookupTotal ? "match" : "differ") << std::endl;
+    std::cout << "\n";
+
+    std::cout << "TEST 11 (Variables bound to slots)" << std::endl;
+    CompiledExpression bound6(node6, {"Xray", "Yellow", "Zebra"});
+    std::vector<double> slots6 = bound6.bind(symTab);
+    std::cout << "Slots: Xray = " << slots6[0] << ", Yellow = " << slots6[1] << ", Zebra = " << slots6[2] << std::endl;
+    std::cout << "Evaluation: " << bound6.evaluate(slots6.data()) << std::endl;
+    double slotTotal = 0.0;
+    auto slotStart = std::chrono::steady_clock::now();
+    for (int i = 0; i < EVALUATIONS; i++) {
+        slotTotal += bound6.evaluate(slots6.data());
+    }
+    auto slotEnd = std::chrono::steady_clock::now();
+    std::cout << "Slot evaluation (" << EVALUATIONS << " evaluations): "
+              << std::chrono::duration<double, std::milli>(slotEnd - slotStart).count() << " ms, total "
+              << (slotTotal == treeTotal ? "matches" : "differs from") << " tree" << std::endl;
+    try {
+        CompiledExpression unbound(node6, {"Xray", "Yellow"});
+    } catch (const std::invalid_argument& error) {
+        std::cout << "Bind error: " << error.what() << std::endl;
+    }
+    std::cout << "\n";
+
+    std::cout << "TEST 12 (Batch evaluation)" << std::endl;
+    const std::size_t POINTS = 1000000;
+    std::vector<std::vector<double>> columns(3, std::vector<double>(POINTS));
+    for (std::size_t k = 0; k < POINTS; k++) {
+        columns[0][k] = 2.0 + k % 7;
+        columns[1][k] = 3.0 + k % 5;
+        columns[2][k] = 5.0 + k % 3;
+    }
+    double pointTotal = 0.0;
+    auto pointStart = std::chrono::steady_clock::now();
+    for (std::size_t k = 0; k < POINTS; k++) {
+        double point[3] = {columns[0][k], columns[1][k], columns[2][k]};
+        pointTotal += bound6.evaluate(point);
+    }
+    auto batchStart = std::chrono::steady_clock::now();
+    std::vector<double> batchResults = bound6.evaluateBatch(columns, 0);
+    auto batchEnd = std::chrono::steady_clock::now();
+    double batchTotal = 0.0;
+    for (double result : batchResults) {
+        batchTotal += result;
+    }
+    std::cout << "Point by point vs batch (" << POINTS << " points): "
+              << std::chrono::duration<double, std::milli>(batchStart - pointStart).count() << " ms vs "
+              << std::chrono::duration<double, std::milli>(batchEnd - batchStart).count() << " ms, totals "
+              << (pointTotal == batchTotal ? "match" : "differ") << std::endl;
+    std::cout << "\n";
+
+    std::cout << "TEST 13 (Simplification)" << std::endl;
+    node_ptr node13 = std::make_shared<Add>(
+                            std::make_shared<Mul>(
+                                std::make_shared<Variable>("x"),
+                                std::make_shared<Constant>(0.0)
+                            ),
+                            std::make_shared<Mul>(
+                                std::make_shared<Constant>(3.0),
+                                std::make_shared<Constant>(1.0)
+                            )
+                    );
+    std::cout << "Expression Tree: " << node13 << std::endl;
+    std::cout << "Simplified: " << simplify(node13) << std::endl;
+    node_ptr higherDerivative = node7;
+    for (int order = 1; order <= 4; order++) {
+        higherDerivative = higherDerivative->derivative("Xray");
+    }
+    std::cout << "Fourth derivative of TEST 7: " << countNodes(higherDerivative) << " nodes, evaluation "
+              << higherDerivative->evaluate(symTab) << std::endl;
+    std::cout << "\n";
+
+    std::cout << "TEST 14 (Shared subtrees)" << std::endl;
+    NodeFactory factory;
+    node_ptr sharedDerivative = factory.intern(node7);
+    for (int order = 1; order <= 5; order++) {
+        sharedDerivative = factory.intern(sharedDerivative->derivative("Xray"));
+    }
+    CompiledExpression compiledDerivative(sharedDerivative);
+    std::cout << "Fifth derivative of TEST 7: " << countNodes(sharedDerivative) << " nodes as a tree, "
+              << compiledDerivative.size() << " distinct" << std::endl;
+    std::cout << "Evaluation (tree, shared, compiled): " << sharedDerivative->evaluate(symTab) << ", "
+              << evaluateShared(sharedDerivative, symTab) << ", " << compiledDerivative.evaluate(symTab) << std::endl;
+    std::cout << "Same node for Xray * Yellow and Yellow * Xray: "
+              << (factory.mul(factory.variable("Xray"), factory.variable("Yellow"))
+                  == factory.mul(factory.variable("Yellow"), factory.variable("Xray")) ? "yes" : "no") << std::endl;
+    std::cout << "\n";
+
+    std::cout << "TEST 15 (Reverse-mode gradient)" << std::endl;
+    SymbolTable gradient6 = compiled6.gradient(symTab);
+    std::cout << "Gradient of TEST 6: d/dXray = " << gradient6["Xray"] << ", d/dYellow = " << gradient6["Yellow"]
+              << ", d/dZebra = " << gradient6["Zebra"] << std::endl;
+    const int GRADIENT_VARIABLES = 200;
+    SymbolTable chainSymbols;
+    node_ptr chain = std::make_shared<Constant>(0.0);
+    for (int i = 0; i < GRADIENT_VARIABLES; i++) {
+        std::string name = "v" + std::to_string(i);
+        std::string next = "v" + std::to_string(i + 1);
+        chainSymbols[name] = 1.0 + i * 0.01;
+        chainSymbols[next] = 1.0 + (i + 1) * 0.01;
+        chain = std::make_shared<Add>(chain, std::make_shared<Div>(std::make_shared<Variable>(name),
+                                                                   std::make_shared<Variable>(next)));
+    }
+    CompiledExpression compiledChain(chain);
+    auto reverseStart = std::chrono::steady_clock::now();
+    SymbolTable chainGradient = compiledChain.gradient(chainSymbols);
+    auto symbolicStart = std::chrono::steady_clock::now();
+    double largestDifference = 0.0;
+    for (const auto& partial : chainGradient) {
+        double symbolic = chain->derivative(partial.first)->evaluate(chainSymbols);
+        largestDifference = std::max(largestDifference, std::abs(symbolic - partial.second));
+    }
+    auto symbolicEnd = std::chrono::steady_clock::now();
+    std::cout << "Gradient over " << chainGradient.size() << " variables, reverse mode vs one derivative each: "
+              << std::chrono::duration<double, std::milli>(symbolicStart - reverseStart).count() << " ms vs "
+              << std::chrono::duration<double, std::milli>(symbolicEnd - symbolicStart).count()
+              << " ms, largest difference " << largestDifference << std::endl;
+    std::cout << "\n";
+
+    std::cout << "TEST 16 (Parser)" << std::endl;
+    node_ptr node16 = parseExpression("(2 + x) * y / Zebra");
+    std::cout << "Expression Tree: " << node16 << std::endl;
+    std::cout << "Evaluation: " << node16->evaluate(symTab) << std::endl;
+    ExpressionParser parser;
+    const int PARSES = 1000000;
+    const char* formulas[] = {"(2 + x) * y / Zebra", "2.3 * Xray + Yellow * (Zebra - Xray)", "-x * y - 3.5"};
+    std::size_t parsedNodes = 0;
+    auto parseStart = std::chrono::steady_clock::now();
+    for (int i = 0; i < PARSES; i++) {
+        parsedNodes += parser.parse(formulas[i % 3]) != nullptr;
+    }
+    auto parseEnd = std::chrono::steady_clock::now();
+    std::cout << "Parsed " << parsedNodes << " expressions in "
+              << std::chrono::duration<double, std::milli>(parseEnd - parseStart).count() << " ms" << std::endl;
+    try {
+        parseExpression("(2 + x) * / y");
+    } catch (const ParseError& error) {
+        std::cout << "Parse error: " << error.what() << std::endl;
+    }
+    std::cout << "\n";
+
+    std::cout << "TEST 17 (Incremental re-evaluation)" << std::endl;
+    const int INCREMENTAL_VARIABLES = 4096;
+    std::vector<node_ptr> terms;
+    std::vector<double> incrementalSlots;
+    for (int i = 0; i < INCREMENTAL_VARIABLES; i++) {
+        terms.push_back(std::make_shared<Mul>(std::make_shared<Variable>("w" + std::to_string(i)),
+                                              std::make_shared<Constant>(1.0 + i % 7)));
+        incrementalSlots.push_back(0.5 + i % 11);
+    }
+    // Pairwise sums, so each variable is a short path from the root
+    while (terms.size() > 1) {
+        std::vector<node_ptr> sums;
+        for (std::size_t i = 0; i + 1 < terms.size(); i += 2) {
+            sums.push_back(std::make_shared<Add>(terms[i], terms[i + 1]));
+        }
+        if (terms.size() % 2 == 1) {
+            sums.push_back(terms.back());
+        }
+        terms = sums;
+    }
+    CompiledExpression compiledSum(terms[0]);
+    IncrementalEvaluator incremental(compiledSum, incrementalSlots.data());
+    const int UPDATES = 100000;
+    double incrementalTotal = 0.0;
+    std::size_t recomputedTotal = 0;
+    auto incrementalStart = std::chrono::steady_clock::now();
+    for (int i = 0; i < UPDATES; i++) {
+        incremental.set(static_cast<std::size_t>(i * 37 % INCREMENTAL_VARIABLES), i * 0.25);
+        incrementalTotal += incremental.evaluate();
+        recomputedTotal += incremental.recomputed();
+    }
+    auto fullStart = std::chrono::steady_clock::now();
+    double fullTotal = 0.0;
+    for (int i = 0; i < UPDATES; i++) {
+        incrementalSlots[i * 37 % INCREMENTAL_VARIABLES] = i * 0.25;
+        fullTotal += compiledSum.evaluate(incrementalSlots.data());
+    }
+    auto fullEnd = std::chrono::steady_clock::now();
+    std::cout << UPDATES << " single-variable updates of a " << compiledSum.size() << "-instruction tape, "
+              << static_cast<double>(recomputedTotal) / UPDATES << " instructions recomputed per update" << std::endl;
+    std::cout << "Incremental vs full: "
+              << std::chrono::duration<double, std::milli>(fullStart - incrementalStart).count() << " ms vs "
+              << std::chrono::duration<double, std::milli>(fullEnd - fullStart).count() << " ms, totals "
+              << (incrementalTotal == fullTotal ? "match" : "differ") << std::endl;
+    std::cout << "\n";
+
+    std::cout << "TEST 18 (Native code)" << std::endl;
+    JitExpression jit6(bound6);
+    if (jit6.native()) {
+        std::cout << "Evaluation: " << jit6.evaluate(slots6.data()) << std::endl;
+        JitExpression::NativeFunction native6 = jit6.nativeFunction();
+        double nativeTotal = 0.0;
+        EvalErrors nativeErrors = 0;
+        auto nativeStart = std::chrono::steady_clock::now();
+        for (int i = 0; i < EVALUATIONS; i++) {
+            nativeTotal += native6(slots6.data(), &nativeErrors);
+        }
+        auto nativeEnd = std::chrono::steady_clock::now();
+        std::cout << "Native evaluation (" << EVALUATIONS << " evaluations): "
+                  << std::chrono::duration<double, std::milli>(nativeEnd - nativeStart).count() << " ms, total "
+                  << (nativeTotal == treeTotal ? "matches" : "differs from") << " tree" << std::endl;
+    } else {
+        std::cout << "Native code unavailable, using the tape: " << jit6.error() << std::endl;
+        std::cout << "Evaluation: " << jit6.evaluate(slots6.data()) << std::endl;
+    }
+    std::cout << "\n";
+
+    std::cout << "TEST 19 (String of a deep tree)" << std::endl;
+    const int STRING_DEPTH = 100000;
+    node_ptr deep = std::make_shared<Variable>("x");
+    for (int i = 0; i < STRING_DEPTH; i++) {
+        deep = std::make_shared<Add>(deep, std::make_shared<Constant>(i * 0.5));
+    }
+    auto stringStart = std::chrono::steady_clock::now();
+    std::string deepText = deep->toString();
+    auto stringEnd = std::chrono::steady_clock::now();
+    std::cout << "Depth " << STRING_DEPTH << ": " << deepText.size() << " characters in "
+              << std::chrono::duration<double, std::milli>(stringEnd - stringStart).count() << " ms, ending "
+              << deepText.substr(deepText.size() - 24) << std::endl;
+    std::cout << "\n";
+
+    std::cout << "TEST 20 (Binary serialization)" << std::endl;
+    const int STORED_EXPRESSIONS = 100000;
+    std::vector<unsigned char> stored;
+    for (int i = 0; i < STORED_EXPRESSIONS; i++) {
+        CompiledExpression(parser.parse(formulas[i % 3])).serialize(stored);
+    }
+    auto loadStart = std::chrono::steady_clock::now();
+    std::vector<CompiledExpression> loaded = CompiledExpression::loadAll(stored.data(), stored.size());
+    auto loadEnd = std::chrono::steady_clock::now();
+    std::cout << "Loaded " << loaded.size() << " expressions (" << stored.size() << " bytes) in "
+              << std::chrono::duration<double, std::milli>(loadEnd - loadStart).count() << " ms" << std::endl;
+    std::cout << "Evaluation of the first: " << loaded[0].evaluate(symTab) << ", parsed: "
+              << node16->evaluate(symTab) << std::endl;
+    try {
+        CompiledExpression::load(stored.data() + 4, stored.size() - 4);
+    } catch (const std::invalid_argument& error) {
+        std::cout << "Load error: " << error.what() << std::endl;
+    }
+    std::cout << "\n";
+
+    std::cout << "TEST 21 (Functions)" << std::endl;
+    node_ptr node21 = parseExpression("sqrt(Xray * Xray + Yellow * Yellow) + sin(Xray) * exp(-Yellow) "
+                                      "- select(Zebra - Yellow, pow(Xray, 3), log(Zebra))");
+    std::cout << "Expression Tree: " << node21 << std::endl;
+    std::cout << "Evaluation: " << node21->evaluate(symTab) << std::endl;
+    std::cout << "Derivative with respect to Xray: " << node21->derivative("Xray") << std::endl;
+    CompiledExpression compiled21(node21, {"Xray", "Yellow", "Zebra"});
+    SymbolTable gradient21 = compiled21.gradient(symTab);
+    std::cout << "Evaluation of derivative (symbolic, reverse mode): " << node21->derivative("Xray")->evaluate(symTab)
+              << ", " << gradient21["Xray"] << std::endl;
+    std::vector<double> functionResults = compiled21.evaluateBatch(columns, 0);
+    double functionTotal = 0.0;
+    for (double result : functionResults) {
+        functionTotal += result;
+    }
+    std::cout << "Batch over " << functionResults.size() << " points, mean " << functionTotal / functionResults.size()
+              << std::endl;
+    node_ptr guard21 = parseExpression("select(x, 1 / x, 0)");
+    SymbolTable zero21{{"x", 0.0}};
+    std::cout << "Guarded division " << guard21 << " at x = 0: " << guard21->evaluate(zero21) << ", compiled "
+              << CompiledExpression(guard21).evaluate(zero21) << ", derivative " << guard21->derivative("x")->evaluate(zero21)
+              << std::endl;
+    std::cout << "\n";
+
+    std::cout << "TEST 22 (Parallel evaluation)" << std::endl;
+    const int PARALLEL_TERMS = 1 << 17;
+    std::vector<node_ptr> parallelTerms;
+    std::vector<std::string> parallelNames;
+    std::vector<double> parallelSlots;
+    for (int i = 0; i < 64; i++) {
+        parallelNames.push_back("w" + std::to_string(i));
+        parallelSlots.push_back(0.25 + i % 13);
+    }
+    for (int i = 0; i < PARALLEL_TERMS; i++) {
+        parallelTerms.push_back(std::make_shared<Mul>(std::make_shared<Sin>(std::make_shared<Variable>(parallelNames[i % 64])),
+                                                      std::make_shared<Constant>(1.0 + i % 5)));
+    }
+    while (parallelTerms.size() > 1) {
+        std::vector<node_ptr> sums;
+        for (std::size_t i = 0; i + 1 < parallelTerms.size(); i += 2) {
+            sums.push_back(std::make_shared<Add>(parallelTerms[i], parallelTerms[i + 1]));
+        }
+        parallelTerms = sums;
+    }
+    CompiledExpression serial22(parallelTerms[0], parallelNames);
+    ThreadPool pool22;
+    ParallelExpression parallel22(parallelTerms[0], parallelNames, pool22);
+    const int PARALLEL_RUNS = 20;
+    double serialTotal = 0.0;
+    double parallelTotal = 0.0;
+    auto serialStart = std::chrono::steady_clock::now();
+    for (int i = 0; i < PARALLEL_RUNS; i++) {
+        serialTotal += serial22.evaluate(parallelSlots.data());
+    }
+    auto parallelStart = std::chrono::steady_clock::now();
+    for (int i = 0; i < PARALLEL_RUNS; i++) {
+        parallelTotal += parallel22.evaluate(parallelSlots.data());
+    }
+    auto parallelEnd = std::chrono::steady_clock::now();
+    std::cout << serial22.size() << " instructions split into " << parallel22.numTasks() << " tasks" << std::endl;
+    std::cout << "Serial vs parallel (" << pool22.size() << " threads): "
+              << std::chrono::duration<double, std::milli>(parallelStart - serialStart).count() << " ms vs "
+              << std::chrono::duration<double, std::milli>(parallelEnd - parallelStart).count() << " ms, totals "
+              << (serialTotal == parallelTotal ? "match" : "differ") << std::endl;
+    std::cout << "\n";
+
+    std::cout << "TEST 23 (Evaluation without exceptions)" << std::endl;
+    EvalErrors errors23 = 0;
+    std::cout << "Evaluation of " << node9 << ": " << node9->tryEvaluate(symTab, errors23) << ", error mask "
+              << static_cast<int>(errors23) << std::endl;
+    SymbolTable partial23{{"Xray", 2.0}};
+    errors23 = 0;
+    std::cout << "Evaluation of " << node6 << " without Yellow and Zebra: " << node6->tryEvaluate(partial23, errors23)
+              << ", error mask " << static_cast<int>(errors23) << std::endl;
+    CompiledExpression compiled23(parseExpression("Xray / (Yellow - 3) + Zebra"), {"Xray", "Yellow", "Zebra"});
+    try {
+        compiled23.evaluateBatch(columns);
+        std::cout << "Batch evaluation: no error" << std::endl;
+    } catch (const std::runtime_error& error) {
+        std::cout << "Batch evaluation error: " << error.what() << std::endl;
+    }
+    std::vector<EvalErrors> rowErrors;
+    std::vector<double> flaggedResults = compiled23.tryEvaluateBatch(columns, rowErrors, 0);
+    std::size_t flaggedRows = 0;
+    std::size_t matchingRows = 0;
+    for (std::size_t k = 0; k < flaggedResults.size(); k++) {
+        if (rowErrors[k] != 0) {
+            flaggedRows += rowErrors[k] == EVAL_DIVIDE_BY_ZERO && std::isnan(flaggedResults[k]);
+        } else {
+            double point[3] = {columns[0][k], columns[1][k], columns[2][k]};
+            matchingRows += compiled23.evaluate(point) == flaggedResults[k];
+        }
+    }
+    std::cout << flaggedRows << " of " << flaggedResults.size() << " points flagged with NaN, " << matchingRows
+              << " others match point by point evaluation" << std::endl;
     std::cout << "\n";
 
     return 0;